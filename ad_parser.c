@@ -0,0 +1,180 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Advertising data parser. Walks the AD structures of a scan report once, never reading
+ *         beyond the reported length, and matches service UUIDs, service data and manufacturer
+ *         data against a table of patterns.
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "ad_parser.h"
+
+// Value classes, by the AD type and the size of the value at its start. 0 is not matched.
+#define CLASS_NONE          0
+#define CLASS_UUID16_LIST   1
+#define CLASS_UUID32_LIST   2
+#define CLASS_UUID128_LIST  3
+#define CLASS_DATA_UUID16   4
+#define CLASS_DATA_UUID32   5
+#define CLASS_DATA_UUID128  6
+#define CLASS_MANUFACTURER  7
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+// One load per AD structure instead of a branch per AD type
+static const uint8_t type_class[256] = {
+  [AD_TYPE_UUID16_INCOMPLETE] = CLASS_UUID16_LIST,
+  [AD_TYPE_UUID16_COMPLETE] = CLASS_UUID16_LIST,
+  [AD_TYPE_UUID32_INCOMPLETE] = CLASS_UUID32_LIST,
+  [AD_TYPE_UUID32_COMPLETE] = CLASS_UUID32_LIST,
+  [AD_TYPE_UUID128_INCOMPLETE] = CLASS_UUID128_LIST,
+  [AD_TYPE_UUID128_COMPLETE] = CLASS_UUID128_LIST,
+  [AD_TYPE_SERVICE_DATA_UUID16] = CLASS_DATA_UUID16,
+  [AD_TYPE_SERVICE_DATA_UUID32] = CLASS_DATA_UUID32,
+  [AD_TYPE_SERVICE_DATA_UUID128] = CLASS_DATA_UUID128,
+  [AD_TYPE_MANUFACTURER_DATA] = CLASS_MANUFACTURER
+};
+
+static const uint8_t class_len[8] = { 0, 2, 4, 16, 2, 4, 16, 2 };
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static uint8_t pattern_class(const ad_pattern_t *pattern);
+static inline uint32_t match_value(const uint8_t *value, uint8_t cls, const ad_pattern_set_t *set);
+static inline bool equal(const uint8_t *a, const uint8_t *b, uint8_t len);
+static inline uint32_t load32(const uint8_t *p);
+static inline uint16_t load16(const uint8_t *p);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+void ad_parser_set_init(ad_pattern_set_t *set, const ad_pattern_t *patterns, uint8_t count)
+{
+  if (count > AD_PARSER_MAX_PATTERNS) {
+    count = AD_PARSER_MAX_PATTERNS;
+  }
+  set->patterns = patterns;
+  set->count = count;
+  set->classes = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    set->pattern_class[i] = pattern_class(&patterns[i]);
+    set->classes |= 1 << set->pattern_class[i];
+  }
+  // Patterns of no class never match
+  set->classes &= ~(1 << CLASS_NONE);
+}
+
+uint32_t ad_parser_match(const uint8_t *data, uint8_t len, const ad_pattern_set_t *set)
+{
+  const uint8_t *end = data + len;
+  const uint8_t *field;
+  const uint8_t *next;
+  uint32_t all = (set->count == 32) ? 0xFFFFFFFFUL : ((1UL << set->count) - 1);
+  uint32_t found = 0;
+  uint8_t cls;
+  uint8_t value_len;
+
+  // Each AD structure is a length byte, then the AD type and the data it counts
+  while (end - data >= 2) {
+    // A zero length ends the significant part, the rest is padding. A structure running past the
+    // end is truncated, nothing after it can be trusted.
+    if (data[0] == 0 || data[0] > end - data - 1) {
+      break;
+    }
+    next = data + 1 + data[0];
+    cls = type_class[data[1]];
+
+    if (set->classes & (1 << cls)) {
+      field = data + 2;
+      value_len = class_len[cls];
+      if (cls <= CLASS_UUID128_LIST) {
+        // A list of UUIDs, a partial one at the end is ignored
+        for (; next - field >= value_len; field += value_len) {
+          found |= match_value(field, cls, set);
+        }
+      } else if (next - field >= value_len) {
+        // Service data and manufacturer data start with the UUID or the company identifier
+        found |= match_value(field, cls, set);
+      }
+      if (found == all) {
+        break;
+      }
+    }
+    data = next;
+  }
+  return found;
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+static uint8_t pattern_class(const ad_pattern_t *pattern)
+{
+  for (uint8_t cls = CLASS_UUID16_LIST; cls <= CLASS_MANUFACTURER; cls++) {
+    if (pattern->len == class_len[cls]
+        && ((pattern->kind == AD_PATTERN_SERVICE_UUID && cls <= CLASS_UUID128_LIST)
+            || (pattern->kind == AD_PATTERN_SERVICE_DATA && cls >= CLASS_DATA_UUID16 && cls <= CLASS_DATA_UUID128)
+            || (pattern->kind == AD_PATTERN_MANUFACTURER && cls == CLASS_MANUFACTURER))) {
+      return cls;
+    }
+  }
+  return CLASS_NONE;
+}
+
+static inline uint32_t match_value(const uint8_t *value, uint8_t cls, const ad_pattern_set_t *set)
+{
+  uint32_t found = 0;
+
+  for (uint8_t i = 0; i < set->count; i++) {
+    if (set->pattern_class[i] == cls && equal(value, set->patterns[i].value, class_len[cls])) {
+      found |= 1UL << i;
+    }
+  }
+  return found;
+}
+
+// Word compares, the first word rejects almost every mismatch
+static inline bool equal(const uint8_t *a, const uint8_t *b, uint8_t len)
+{
+  switch (len) {
+    case 2:
+      return load16(a) == load16(b);
+    case 4:
+      return load32(a) == load32(b);
+    default:
+      return load32(a) == load32(b)
+             && load32(a + 4) == load32(b + 4)
+             && load32(a + 8) == load32(b + 8)
+             && load32(a + 12) == load32(b + 12);
+  }
+}
+
+// The advertising data has no alignment, memcpy compiles to a single unaligned load on Cortex-M
+static inline uint32_t load32(const uint8_t *p)
+{
+  uint32_t value;
+
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline uint16_t load16(const uint8_t *p)
+{
+  uint16_t value;
+
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
@@ -0,0 +1,90 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Advertising data parser header file
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef AD_PARSER_H
+#define AD_PARSER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************************************//**
+ * @addtogroup Application
+ * @{
+ **************************************************************************************************/
+
+/***********************************************************************************************//**
+ * @addtogroup app
+ * @{
+ **************************************************************************************************/
+
+// AD types, Core Specification Supplement Part A
+#define AD_TYPE_UUID16_INCOMPLETE     0x02
+#define AD_TYPE_UUID16_COMPLETE       0x03
+#define AD_TYPE_UUID32_INCOMPLETE     0x04
+#define AD_TYPE_UUID32_COMPLETE       0x05
+#define AD_TYPE_UUID128_INCOMPLETE    0x06
+#define AD_TYPE_UUID128_COMPLETE      0x07
+#define AD_TYPE_SERVICE_DATA_UUID16   0x16
+#define AD_TYPE_SERVICE_DATA_UUID32   0x20
+#define AD_TYPE_SERVICE_DATA_UUID128  0x21
+#define AD_TYPE_MANUFACTURER_DATA     0xFF
+
+#define AD_PARSER_MAX_PATTERNS        32   // One bit each in the match result
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef enum {
+  AD_PATTERN_SERVICE_UUID = 0,  // In a complete or incomplete service UUID list
+  AD_PATTERN_SERVICE_DATA,      // Service data of the UUID
+  AD_PATTERN_MANUFACTURER       // Manufacturer specific data of the company identifier
+} ad_pattern_kind_t;
+
+typedef struct {
+  uint8_t kind;                 // ad_pattern_kind_t
+  uint8_t len;                  // UUID size, 2, 4 or 16 bytes. 2 for the company identifier.
+  uint8_t value[16];            // Little endian, as in the advertisement
+} ad_pattern_t;
+
+// Patterns prepared for matching by ad_parser_set_init()
+typedef struct {
+  const ad_pattern_t *patterns;
+  uint8_t count;
+  uint8_t classes;                              // Mask of the value classes of all patterns
+  uint8_t pattern_class[AD_PARSER_MAX_PATTERNS];
+} ad_pattern_set_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+// The patterns are referenced, not copied
+void ad_parser_set_init(ad_pattern_set_t *set, const ad_pattern_t *patterns, uint8_t count);
+
+// Match the advertising data against all patterns of the set in one pass. Returns a mask with bit n
+// set if patterns[n] was found. Malformed data is parsed up to the first AD structure that does not
+// fit, data beyond len is never read.
+uint32_t ad_parser_match(const uint8_t *data, uint8_t len, const ad_pattern_set_t *set);
+
+/** @} (end addtogroup app) */
+/** @} (end addtogroup Application) */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* AD_PARSER_H */
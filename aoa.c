@@ -22,33 +22,640 @@
 #include <math.h>
 
 #include "aoa.h"
+#include "sl_app_assert.h"
+#include "aoa_cfg.h"
+
+#define DEG_TO_RAD  (3.14159265f / 180.0f)
 
 /***************************************************************************************************
  * Static Variable Declarations
  **************************************************************************************************/
 
+// Supported antenna arrays, indexed by ARRAY_TYPE_*
+static const aoa_array_desc_t array_descs[ARRAY_TYPE_COUNT] = {
+  [ARRAY_TYPE_4x4_URA] = {
+    .array_type = SL_RTL_AOX_ARRAY_TYPE_4x4_URA,
+    .num_elements = 4 * 4,
+    .num_snapshots = 4,
+    .ref_period_samples = 7,
+    .switching_pattern = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+  },
+  [ARRAY_TYPE_3x3_URA] = {
+    .array_type = SL_RTL_AOX_ARRAY_TYPE_3x3_URA,
+    .num_elements = 3 * 3,
+    .num_snapshots = 4,
+    .ref_period_samples = 7,
+    .switching_pattern = { 1, 2, 3, 5, 6, 7, 9, 10, 11 },
+  },
+  [ARRAY_TYPE_1x4_ULA] = {
+    .array_type = SL_RTL_AOX_ARRAY_TYPE_1x4_ULA,
+    .num_elements = 1 * 4,
+    .num_snapshots = 18,
+    .ref_period_samples = 7,
+    .switching_pattern = { 0, 1, 2, 3 },
+  },
+};
+
+// Array in use, selected once at boot
+static const aoa_array_desc_t *array;
+
+// IQ sample buffers shared by all tags, reports are converted and processed one at a time.
+// Sized for the selected array in aoa_init().
+static float *ref_i_rows[1];
+static float *ref_q_rows[1];
+static float **i_rows;
+static float **q_rows;
+
+// Estimator instances shared by all tags
+static struct {
+  aoa_libitems_t items;
+  uint32_t owner;       // Tag state id of the lessee, 0 if free. Also released by aoa_tag_deinit()
+                        // while an estimate runs, a lost lease only costs a reset estimator.
+  uint32_t last_used;   // Lease counter value of the last use, for least recently used reuse
+  uint8_t generation;   // Configuration generation the estimator was created with
+} estimator_pool[AOA_ESTIMATOR_POOL_SIZE];
+
+static uint32_t lease_counter;
+static uint32_t next_tag_id;
+
+// Antenna calibration as complex factors, with the int8 to float scaling folded in
+static float cal_re[AOA_CAL_CHANNEL_GROUPS][AOA_MAX_ARRAY_ELEMENTS];
+static float cal_im[AOA_CAL_CHANNEL_GROUPS][AOA_MAX_ARRAY_ELEMENTS];
+static uint8_t cal_generation;
+static bool cal_valid;
+
 /***************************************************************************************************
  * Static Function Declarations
  **************************************************************************************************/
 
+static void init_estimator(aoa_libitems_t *aoa_state);
+static void alloc_sample_buffers(void);
+static void set_descriptor_order(aoa_tag_state_t *tag_state);
+static void deinit_estimator(aoa_libitems_t *aoa_state);
+static uint8_t lease_estimator(aoa_tag_state_t *tag_state);
+static void drop_channel_group(const aoa_tag_state_t *tag_state);
+static void load_calibration(void);
+static void filter_estimate(aoa_tag_state_t *tag_state, aoa_angle_t *angle);
 static enum sl_rtl_error_code aox_process_samples(aoa_libitems_t *aoa_state, iq_samples_t *samples, float *azimuth, float *elevation, uint32_t *qa_result);
 static float calc_frequency_from_channel(uint8_t channel);
+static uint8_t calc_confidence(aoa_libitems_t *aoa_state, uint32_t qa_result, int16_t rssi);
 
 /***************************************************************************************************
  * Public Function Definitions
  **************************************************************************************************/
-void aoa_init(aoa_libitems_t *aoa_state)
+void aoa_init(void)
+{
+  uint8_t array_id = aoa_cfg_get_array_id();
+
+  if (array_id >= ARRAY_TYPE_COUNT) {
+    array_id = ARRAY_TYPE_DEFAULT;
+  }
+  array = &array_descs[array_id];
+  alloc_sample_buffers();
+
+  // The heap used by the estimators is allocated here once, independent of the number of tags
+  for (uint8_t i = 0; i < AOA_ESTIMATOR_POOL_SIZE; i++) {
+    init_estimator(&estimator_pool[i].items);
+    estimator_pool[i].owner = 0;
+    estimator_pool[i].last_used = 0;
+    estimator_pool[i].generation = aoa_cfg_get_generation();
+  }
+  lease_counter = 0;
+}
+
+void aoa_start(void)
+{
+  uint32_t seed = 0;
+  size_t len;
+  sl_status_t sc;
+
+  // From the radio's entropy source, so that patterns differ between boots and locators
+  sc = sl_bt_system_get_random_data(sizeof(seed), sizeof(seed), &len, (uint8_t *)&seed);
+  sl_app_assert(sc == SL_STATUS_OK && len == sizeof(seed),
+                "[E: 0x%04x] Failed to get random data\n",
+                (int)sc);
+  srand(seed);
+}
+
+const aoa_array_desc_t* aoa_get_array(void)
+{
+  return array;
+}
+
+void aoa_tag_init(aoa_tag_state_t *tag_state, aoa_channel_group_t *group)
+{
+  // Ids tell a tag apart from an earlier one that used the same table slot
+  if (++next_tag_id == 0) {
+    next_tag_id = 1;
+  }
+  tag_state->id = next_tag_id;
+  tag_state->group = group;
+  drop_channel_group(tag_state);
+  tag_state->estimator = AOA_ESTIMATOR_NONE;
+  tag_state->warmup = 0;
+  tag_state->filter_valid = false;
+
+  // Descriptor order until a pattern is applied at sync
+  set_descriptor_order(tag_state);
+}
+
+void aoa_tag_deinit(aoa_tag_state_t *tag_state)
 {
+  drop_channel_group(tag_state);
+  if (tag_state->estimator < AOA_ESTIMATOR_POOL_SIZE
+      && estimator_pool[tag_state->estimator].owner == tag_state->id) {
+    estimator_pool[tag_state->estimator].owner = 0;
+  }
+  tag_state->estimator = AOA_ESTIMATOR_NONE;
 }
 
-sl_status_t aoa_calculate(aoa_libitems_t *aoa_state, iq_samples_t *iq_samples, aoa_angle_t *angle)
+void aoa_tag_set_pattern(aoa_tag_state_t *tag_state, uint8_t max_elements)
 {
+  const aoa_switch_pattern_t *config = aoa_cfg_get_switch_pattern();
+  uint8_t element;
+  uint8_t swap;
+  uint8_t tmp;
+  uint32_t used = 0;
+
+  // Collected reports were sampled in the previous order
+  drop_channel_group(tag_state);
+
+  switch (config->mode) {
+    case AOA_SWITCH_PATTERN_RANDOM:
+      // Fisher-Yates shuffle of the descriptor order
+      set_descriptor_order(tag_state);
+      for (element = array->num_elements - 1; element > 0; element--) {
+        swap = (uint8_t)(rand() % (element + 1));
+        tmp = tag_state->pattern[element];
+        tag_state->pattern[element] = tag_state->pattern[swap];
+        tag_state->pattern[swap] = tmp;
+      }
+      break;
+
+    case AOA_SWITCH_PATTERN_EXTERNAL:
+      // The list was checked against the array it was configured for, the array may have changed since
+      if (config->len > 0 && config->len <= array->num_elements) {
+        for (element = 0; element < config->len; element++) {
+          if (config->elements[element] >= array->num_elements
+              || (used & (1UL << config->elements[element])) != 0) {
+            break;
+          }
+          used |= 1UL << config->elements[element];
+          tag_state->pattern[element] = config->elements[element];
+        }
+        if (element == config->len) {
+          tag_state->pattern_len = config->len;
+          break;
+        }
+      }
+      set_descriptor_order(tag_state);
+      break;
+
+    default:
+      set_descriptor_order(tag_state);
+      break;
+  }
+
+  // Reduced pattern, the leading elements of the order drawn
+  if (max_elements > 0 && max_elements < tag_state->pattern_len) {
+    tag_state->pattern_len = max_elements;
+  }
+}
+
+uint8_t aoa_tag_get_antennas(const aoa_tag_state_t *tag_state, uint8_t *antennas)
+{
+  for (uint8_t i = 0; i < tag_state->pattern_len; i++) {
+    antennas[i] = array->switching_pattern[tag_state->pattern[i]];
+  }
+  return tag_state->pattern_len;
+}
+
+uint8_t aoa_tag_get_report_len(const aoa_tag_state_t *tag_state)
+{
+  // Samples after the last snapshot carry nothing the estimator uses
+  return (array->ref_period_samples + 1 + array->num_snapshots * tag_state->pattern_len) * 2;
+}
+
+static void init_estimator(aoa_libitems_t *aoa_state)
+{
+#if AOA_ESTIMATION_ON_DEVICE
+  // Initialize AoX library
+  sl_rtl_aox_init(&aoa_state->libitem);
+  // Set the number of snapshots - how many times the antennas are scanned during one measurement
+  sl_rtl_aox_set_num_snapshots(&aoa_state->libitem, array->num_snapshots);
+  // Set the antenna array type
+  sl_rtl_aox_set_array_type(&aoa_state->libitem, (enum sl_rtl_aox_array_type)array->array_type);
+  // Select mode (high speed/high accuracy/etc.)
+  sl_rtl_aox_set_mode(&aoa_state->libitem, AOX_MODE);
+  // Combine reports from several channels into one estimate
+  sl_rtl_aox_set_num_radio_channels(&aoa_state->libitem, AOA_NUM_RADIO_CHANNELS);
+  // Enable IQ sample quality analysis processing
+  sl_rtl_aox_iq_sample_qa_configure(&aoa_state->libitem);
+  // Limit the search space to the angles the installation can see
+  const aoa_constraints_t *constraints = aoa_cfg_get_constraints();
+  for (uint8_t i = 0; i < constraints->count; i++) {
+    sl_rtl_aox_add_constraint(&aoa_state->libitem,
+                              (enum sl_rtl_aox_constraint_type)constraints->items[i].type,
+                              constraints->items[i].min_value,
+                              constraints->items[i].max_value);
+  }
+  // Initialize an estimator
+  sl_rtl_aox_create_estimator(&aoa_state->libitem);
+#else
+  (void)aoa_state;
+#endif
+}
+
+static void alloc_sample_buffers(void)
+{
+  // One block per buffer, the rows point into it. Never freed, the array does not change at runtime.
+  float *ref_i = malloc(array->ref_period_samples * sizeof(float));
+  float *ref_q = malloc(array->ref_period_samples * sizeof(float));
+  float *i = malloc(array->num_snapshots * array->num_elements * sizeof(float));
+  float *q = malloc(array->num_snapshots * array->num_elements * sizeof(float));
+
+  i_rows = malloc(array->num_snapshots * sizeof(float *));
+  q_rows = malloc(array->num_snapshots * sizeof(float *));
+  sl_app_assert(ref_i != NULL && ref_q != NULL && i != NULL && q != NULL
+                && i_rows != NULL && q_rows != NULL,
+                "[E: 0x%04x] Failed to allocate IQ sample buffers\n",
+                (int)SL_STATUS_ALLOCATION_FAILED);
+
+  ref_i_rows[0] = ref_i;
+  ref_q_rows[0] = ref_q;
+  for (uint32_t snapshot = 0; snapshot < array->num_snapshots; ++snapshot) {
+    i_rows[snapshot] = &i[snapshot * array->num_elements];
+    q_rows[snapshot] = &q[snapshot * array->num_elements];
+  }
+}
+
+static void set_descriptor_order(aoa_tag_state_t *tag_state)
+{
+  tag_state->pattern_len = array->num_elements;
+  for (uint8_t element = 0; element < array->num_elements; element++) {
+    tag_state->pattern[element] = element;
+  }
+}
+
+sl_status_t aoa_convert_iq_report(const aoa_tag_state_t *tag_state, const uint8_t *samples, uint8_t len, uint8_t channel, iq_samples_t *iq_samples)
+{
+  uint32_t index = 0;
+  const float *re;
+  const float *im;
+  uint8_t element;
+  float i;
+  float q;
+
+  // The estimator needs every element in each snapshot, subsets are only forwarded
+  if (tag_state->pattern_len != array->num_elements) {
+    return SL_STATUS_NOT_SUPPORTED;
+  }
+
+  // The report must hold the reference period and all snapshots
+  if (len < aoa_tag_get_report_len(tag_state)) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  if (!cal_valid || cal_generation != aoa_cfg_get_cal_generation()) {
+    load_calibration();
+  }
+  re = cal_re[(uint32_t)channel * AOA_CAL_CHANNEL_GROUPS / 40];
+  im = cal_im[(uint32_t)channel * AOA_CAL_CHANNEL_GROUPS / 40];
+
+  // Write reference IQ samples into the IQ sample buffer (sampled on one antenna)
+  for (uint32_t sample = 0; sample < array->ref_period_samples; ++sample) {
+    ref_i_rows[0][sample] = ((int8_t)samples[index++]) / 127.0f;
+    ref_q_rows[0][sample] = ((int8_t)samples[index++]) / 127.0f;
+  }
+  index = (array->ref_period_samples + 1) * 2;
+
+  // Write antenna IQ samples into the IQ sample buffer (sampled on all antennas), in array
+  // element order whatever the switching order, correcting each antenna's phase and gain on the way
+  for (uint32_t snapshot = 0; snapshot < array->num_snapshots; ++snapshot) {
+    for (uint32_t slot = 0; slot < tag_state->pattern_len; ++slot) {
+      element = tag_state->pattern[slot];
+      i = (int8_t)samples[index++];
+      q = (int8_t)samples[index++];
+      i_rows[snapshot][element] = i * re[element] - q * im[element];
+      q_rows[snapshot][element] = i * im[element] + q * re[element];
+    }
+  }
+
+  iq_samples->ref_i_samples = ref_i_rows;
+  iq_samples->ref_q_samples = ref_q_rows;
+  iq_samples->i_samples = i_rows;
+  iq_samples->q_samples = q_rows;
+
   return SL_STATUS_OK;
 }
 
+sl_status_t aoa_add_report(aoa_tag_state_t *tag_state, const uint8_t *samples, uint8_t len, uint8_t channel, int8_t rssi, uint16_t event_counter)
+{
+#if AOA_ESTIMATION_ON_DEVICE
+  aoa_channel_group_t *group = tag_state->group;
+  aoa_channel_report_t *report;
+
+  // Checked here, so that the whole group converts later
+  if (tag_state->pattern_len != array->num_elements) {
+    return SL_STATUS_NOT_SUPPORTED;
+  }
+  if (len < aoa_tag_get_report_len(tag_state) || len > AOA_IQ_REPORT_MAX_LEN) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  // A channel already in the group starts a new group, the reports stay in time order
+  for (uint8_t i = 0; i < group->num_reports; i++) {
+    if (group->reports[i].channel == channel) {
+      group->num_reports = 0;
+      break;
+    }
+  }
+
+  report = &group->reports[group->num_reports++];
+  report->len = len;
+  report->channel = channel;
+  report->rssi = rssi;
+  report->event_counter = event_counter;
+  memcpy(report->samples, samples, len);
+
+  if (group->num_reports < AOA_NUM_RADIO_CHANNELS) {
+    return SL_STATUS_IN_PROGRESS;
+  }
+  return SL_STATUS_OK;
+#else
+  (void)tag_state;
+  (void)samples;
+  (void)len;
+  (void)channel;
+  (void)rssi;
+  (void)event_counter;
+  return SL_STATUS_NOT_SUPPORTED;
+#endif
+}
+
+sl_status_t aoa_calculate(aoa_tag_state_t *tag_state, aoa_angle_t *angle)
+{
+#if AOA_ESTIMATION_ON_DEVICE
+  aoa_channel_group_t *group = tag_state->group;
+  aoa_libitems_t *aoa_state;
+  aoa_channel_report_t *report = NULL;
+  iq_samples_t iq_samples;
+  uint32_t qa_result = 0;
+  int32_t rssi_sum = 0;
+  int16_t rssi;
+  enum sl_rtl_error_code ec = SL_RTL_ERROR_ESTIMATION_IN_PROGRESS;
+
+  // Only held while the group is processed, the reports are collected without an estimator
+  aoa_state = &estimator_pool[lease_estimator(tag_state)].items;
+
+  // Feed the channel group back to back, the estimator combines it into one angle
+  for (uint8_t i = 0; i < group->num_reports; i++) {
+    report = &group->reports[i];
+    aoa_convert_iq_report(tag_state, report->samples, report->len, report->channel, &iq_samples);
+    iq_samples.channel = report->channel;
+    ec = aox_process_samples(aoa_state, &iq_samples, &angle->azimuth, &angle->elevation, &qa_result);
+    if (ec != SL_RTL_ERROR_SUCCESS && ec != SL_RTL_ERROR_ESTIMATION_IN_PROGRESS) {
+      break;
+    }
+    rssi_sum += report->rssi;
+  }
+  group->num_reports = 0;
+
+  if (ec == SL_RTL_ERROR_ESTIMATION_IN_PROGRESS) {
+    return SL_STATUS_IN_PROGRESS;
+  }
+  if (ec != SL_RTL_ERROR_SUCCESS || report == NULL) {
+    return SL_STATUS_FAIL;
+  }
+  rssi = (int16_t)(rssi_sum / AOA_NUM_RADIO_CHANNELS);
+
+  // Calculate distance from RSSI, filtered together with the angles
+  sl_rtl_util_rssi2distance(TAG_TX_POWER, rssi, &angle->distance);
+  filter_estimate(tag_state, angle);
+
+  angle->rssi = rssi;
+  angle->channel = report->channel;
+  angle->sequence = report->event_counter;
+  angle->confidence = calc_confidence(aoa_state, qa_result, rssi);
+
+  return SL_STATUS_OK;
+#else
+  (void)tag_state;
+  (void)angle;
+  return SL_STATUS_NOT_SUPPORTED;
+#endif
+}
+
+void aoa_tag_snapshot(aoa_tag_state_t *tag_state, aoa_tag_state_t *snapshot, aoa_channel_group_t *group)
+{
+  *snapshot = *tag_state;
+  snapshot->group = group;
+  if (tag_state->group != NULL) {
+    *group = *tag_state->group;
+  } else {
+    group->num_reports = 0;
+  }
+  // The tag collects its next group meanwhile
+  drop_channel_group(tag_state);
+}
+
+void aoa_tag_update(aoa_tag_state_t *tag_state, const aoa_tag_state_t *snapshot)
+{
+  // A new tag in the same slot starts over. The pattern may have changed meanwhile, only the
+  // estimate is taken over.
+  if (tag_state->id != snapshot->id) {
+    return;
+  }
+  tag_state->estimator = snapshot->estimator;
+  tag_state->warmup = snapshot->warmup;
+  tag_state->filter_valid = snapshot->filter_valid;
+  tag_state->azimuth = snapshot->azimuth;
+  tag_state->elevation = snapshot->elevation;
+  tag_state->distance = snapshot->distance;
+}
+
+// Pool index of the tag's estimator, the one it used last or the least recently used one
+static uint8_t lease_estimator(aoa_tag_state_t *tag_state)
+{
+  uint8_t index = tag_state->estimator;
+
+  lease_counter++;
+
+  // The estimator used last time still holds this tag's history, unless the configuration changed
+  if (index >= AOA_ESTIMATOR_POOL_SIZE
+      || estimator_pool[index].owner != tag_state->id
+      || estimator_pool[index].generation != aoa_cfg_get_generation()) {
+    // Take a free estimator, or the least recently used one
+    index = 0;
+    for (uint8_t i = 0; i < AOA_ESTIMATOR_POOL_SIZE; i++) {
+      if (estimator_pool[i].owner == 0) {
+        index = i;
+        break;
+      }
+      if (estimator_pool[i].last_used < estimator_pool[index].last_used) {
+        index = i;
+      }
+    }
+
+    // Drop the history of the previous lessee, recreate it if the configuration changed
+    if (estimator_pool[index].generation != aoa_cfg_get_generation()) {
+      deinit_estimator(&estimator_pool[index].items);
+      init_estimator(&estimator_pool[index].items);
+      estimator_pool[index].generation = aoa_cfg_get_generation();
+    } else {
+#if AOA_ESTIMATION_ON_DEVICE
+      sl_rtl_aox_reset_estimator(&estimator_pool[index].items.libitem);
+#endif
+    }
+    estimator_pool[index].owner = tag_state->id;
+    tag_state->estimator = index;
+    tag_state->warmup = AOA_LEASE_WARMUP_ESTIMATES;
+  }
+
+  estimator_pool[index].last_used = lease_counter;
+  return index;
+}
+
+static void drop_channel_group(const aoa_tag_state_t *tag_state)
+{
+  if (tag_state->group != NULL) {
+    tag_state->group->num_reports = 0;
+  }
+}
+
+static void load_calibration(void)
+{
+  const aoa_calibration_t *calibration = aoa_cfg_get_calibration();
+  float phase;
+  float gain;
+
+  for (uint32_t group = 0; group < AOA_CAL_CHANNEL_GROUPS; group++) {
+    for (uint32_t antenna = 0; antenna < AOA_MAX_ARRAY_ELEMENTS; antenna++) {
+      phase = calibration->entries[group][antenna].phase * (DEG_TO_RAD / AOA_CAL_PHASE_SCALE);
+      gain = (float)calibration->entries[group][antenna].gain / (AOA_CAL_GAIN_SCALE * 127.0f);
+      cal_re[group][antenna] = gain * cosf(phase);
+      cal_im[group][antenna] = gain * sinf(phase);
+    }
+  }
+
+  cal_generation = aoa_cfg_get_cal_generation();
+  cal_valid = true;
+}
+
+static void filter_estimate(aoa_tag_state_t *tag_state, aoa_angle_t *angle)
+{
+  float delta;
+
+  if (!tag_state->filter_valid) {
+    tag_state->filter_valid = true;
+    tag_state->warmup = 0;
+  } else {
+    angle->distance = tag_state->distance + AOA_DISTANCE_FILTER_WEIGHT * (angle->distance - tag_state->distance);
+
+    // A reset estimator has no history yet, bridge with the tag's previous angles
+    if (tag_state->warmup > 0) {
+      tag_state->warmup--;
+      delta = angle->azimuth - tag_state->azimuth;
+      if (delta > 180.0f) {
+        delta -= 360.0f;
+      } else if (delta < -180.0f) {
+        delta += 360.0f;
+      }
+      angle->azimuth = tag_state->azimuth + AOA_ANGLE_FILTER_WEIGHT * delta;
+      if (angle->azimuth < 0.0f) {
+        angle->azimuth += 360.0f;
+      } else if (angle->azimuth >= 360.0f) {
+        angle->azimuth -= 360.0f;
+      }
+      angle->elevation = tag_state->elevation + AOA_ANGLE_FILTER_WEIGHT * (angle->elevation - tag_state->elevation);
+    }
+  }
+
+  tag_state->azimuth = angle->azimuth;
+  tag_state->elevation = angle->elevation;
+  tag_state->distance = angle->distance;
+}
+
 static enum sl_rtl_error_code aox_process_samples(aoa_libitems_t *aoa_state, iq_samples_t *samples, float *azimuth, float *elevation, uint32_t *qa_result)
 {
-   return SL_RTL_ERROR_SUCCESS;
+#if AOA_ESTIMATION_ON_DEVICE
+  enum sl_rtl_error_code ret;
+  float phase_rotation;
+
+  // Calculate phase rotation from reference IQ samples
+  ret = sl_rtl_aox_calculate_iq_sample_phase_rotation(&aoa_state->libitem, 2.0f, samples->ref_i_samples[0], samples->ref_q_samples[0], array->ref_period_samples, &phase_rotation);
+  if (ret != SL_RTL_ERROR_SUCCESS) {
+    return ret;
+  }
+
+  // Provide calculated phase rotation to the estimator
+  ret = sl_rtl_aox_set_iq_sample_phase_rotation(&aoa_state->libitem, phase_rotation);
+  if (ret != SL_RTL_ERROR_SUCCESS) {
+    return ret;
+  }
+
+  // Estimate Angle of Arrival from IQ samples
+  ret = sl_rtl_aox_process(&aoa_state->libitem, samples->i_samples, samples->q_samples, calc_frequency_from_channel(samples->channel), azimuth, elevation);
+
+  // Get the quality analysis of the processed samples
+  *qa_result = sl_rtl_aox_iq_sample_qa_get_results(&aoa_state->libitem);
+
+  return ret;
+#else
+  (void)aoa_state;
+  (void)samples;
+  (void)azimuth;
+  (void)elevation;
+  (void)qa_result;
+  return SL_RTL_ERROR_FEATURE_NOT_SUPPORTED;
+#endif
+}
+
+static uint8_t calc_confidence(aoa_libitems_t *aoa_state, uint32_t qa_result, int16_t rssi)
+{
+#if AOA_ESTIMATION_ON_DEVICE
+  static sl_rtl_clib_iq_sample_qa_antenna_data_t antenna_data[AOA_MAX_ARRAY_ELEMENTS];
+  sl_rtl_clib_iq_sample_qa_dataset_t qa_dataset;
+  float confidence = 1.0f;
+  float jitter = 0.0f;
+
+  if (qa_result == SL_RTL_AOX_IQ_SAMPLE_QA_FAILURE) {
+    return 0;
+  }
+
+  // Every failed quality check halves the confidence
+  for (uint32_t checks = qa_result; checks != 0; checks &= checks - 1) {
+    confidence *= 0.5f;
+  }
+
+  // Snapshot to snapshot phase spread, averaged over the antennas
+  if (sl_rtl_aox_iq_sample_qa_get_details(&aoa_state->libitem, &qa_dataset, antenna_data) == SL_RTL_ERROR_SUCCESS
+      && qa_dataset.data_available) {
+    for (uint32_t antenna = 0; antenna < array->num_elements; antenna++) {
+      jitter += antenna_data[antenna].phase_jitter;
+    }
+    jitter /= array->num_elements;
+    if (jitter >= AOA_CONFIDENCE_MAX_PHASE_JITTER) {
+      return 0;
+    }
+    confidence *= 1.0f - jitter / AOA_CONFIDENCE_MAX_PHASE_JITTER;
+  }
+
+  // Weak signals give noisy angles
+  if (rssi <= AOA_CONFIDENCE_RSSI_MIN) {
+    return 0;
+  }
+  if (rssi < AOA_CONFIDENCE_RSSI_MAX) {
+    confidence *= (float)(rssi - AOA_CONFIDENCE_RSSI_MIN) / (AOA_CONFIDENCE_RSSI_MAX - AOA_CONFIDENCE_RSSI_MIN);
+  }
+
+  return (uint8_t)(confidence * 100.0f + 0.5f);
+#else
+  (void)aoa_state;
+  (void)qa_result;
+  (void)rssi;
+  return 0;
+#endif
 }
 
 static float calc_frequency_from_channel(uint8_t channel)
@@ -63,7 +670,20 @@ static float calc_frequency_from_channel(uint8_t channel)
   return 2402000000 + 2000000 * logical_to_physical_channel[channel];
 }
 
-sl_status_t aoa_deinit(aoa_libitems_t *aoa_state)
+sl_status_t aoa_deinit(void)
+{
+  for (uint8_t i = 0; i < AOA_ESTIMATOR_POOL_SIZE; i++) {
+    deinit_estimator(&estimator_pool[i].items);
+    estimator_pool[i].owner = 0;
+  }
+  return SL_STATUS_OK;
+}
+
+static void deinit_estimator(aoa_libitems_t *aoa_state)
 {
-  return SL_RTL_ERROR_SUCCESS;
+#if AOA_ESTIMATION_ON_DEVICE
+  sl_rtl_aox_deinit(&aoa_state->libitem);
+#else
+  (void)aoa_state;
+#endif
 }
@@ -37,40 +37,21 @@ extern "C" {
  * @{
  **************************************************************************************************/
 
+// Array descriptors selectable at boot, see aoa_get_array()
 #define ARRAY_TYPE_4x4_URA (0)
 #define ARRAY_TYPE_3x3_URA (1)
 #define ARRAY_TYPE_1x4_ULA (2)
-#define ARRAY_TYPE         ARRAY_TYPE_4x4_URA
+#define ARRAY_TYPE_COUNT   (3)
+#define ARRAY_TYPE_DEFAULT ARRAY_TYPE_4x4_URA
 
 #define AOX_MODE           SL_RTL_AOX_MODE_REAL_TIME_BASIC
 
-#if (ARRAY_TYPE == ARRAY_TYPE_4x4_URA)
-#define AOX_ARRAY_TYPE     SL_RTL_AOX_ARRAY_TYPE_4x4_URA
-#define AOA_NUM_SNAPSHOTS       (4)
-#define AOA_NUM_ARRAY_ELEMENTS   (4 * 4)
-#define AOA_REF_PERIOD_SAMPLES (7)
-#elif (ARRAY_TYPE == ARRAY_TYPE_3x3_URA)
-#define AOX_ARRAY_TYPE     SL_RTL_AOX_ARRAY_TYPE_3x3_URA
-#define AOA_NUM_SNAPSHOTS       (4)
-#define AOA_NUM_ARRAY_ELEMENTS   (3 * 3)
-#define AOA_REF_PERIOD_SAMPLES (7)
-#elif (ARRAY_TYPE == ARRAY_TYPE_1x4_ULA)
-#define AOX_ARRAY_TYPE     SL_RTL_AOX_ARRAY_TYPE_1x4_ULA
-#define AOA_NUM_SNAPSHOTS       (18)
-#define AOA_NUM_ARRAY_ELEMENTS   (1 * 4)
-#define AOA_REF_PERIOD_SAMPLES (7)
-#endif
+// Set to 1 to estimate angles on the locator. Requires the RTL library to be linked.
+#define AOA_ESTIMATION_ON_DEVICE 0
 
-#if (ARRAY_TYPE == ARRAY_TYPE_4x4_URA)
-#define NUM_ANTENNAS       16
-#define SWITCHING_PATTERN  { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }
-#elif (ARRAY_TYPE == ARRAY_TYPE_3x3_URA)
-#define NUM_ANTENNAS       9
-#define SWITCHING_PATTERN  { 1, 2, 3, 5, 6, 7, 9, 10, 11 }
-#elif (ARRAY_TYPE == ARRAY_TYPE_1x4_ULA)
-#define NUM_ANTENNAS       4
-#define SWITCHING_PATTERN  { 0, 1, 2, 3 }
-#endif
+// Upper bounds over all array descriptors
+#define AOA_MAX_ARRAY_ELEMENTS  (16)
+#define AOA_MAX_SNAPSHOTS       (18)
 
 // Silabs mode constats
 #define AOA_SLOT_DURATION 1
@@ -84,12 +65,47 @@ extern "C" {
 
 #define TAG_TX_POWER       (-45.0)        //-45dBm at 1m distance
 
+// Angle confidence: linear RSSI scale, and mean snapshot phase jitter at which confidence drops to 0
+#define AOA_CONFIDENCE_RSSI_MIN          (-90)
+#define AOA_CONFIDENCE_RSSI_MAX          (-50)
+#define AOA_CONFIDENCE_MAX_PHASE_JITTER  (0.5f)  // radians
+
+// Largest IQ report the controller delivers: 82 samples, one I and one Q byte each
+#define AOA_IQ_REPORT_MAX_LEN (82 * 2)
+
 #define AOA_MAX_TAGS 8
 
+// Reports on distinct channels combined into one estimate, for multipath rejection
+#define AOA_NUM_RADIO_CHANNELS       3
+
+// Estimator instances shared by all tags, a tag leases one while its channel group is processed
+#define AOA_ESTIMATOR_POOL_SIZE      2
+#define AOA_ESTIMATOR_NONE           0xFF
+// Estimates smoothed with the tag's own filter state after it got a reset estimator
+#define AOA_LEASE_WARMUP_ESTIMATES   5
+#define AOA_ANGLE_FILTER_WEIGHT      (0.4f)  // Weight of a new angle during warm-up
+#define AOA_DISTANCE_FILTER_WEIGHT   (0.4f)  // Weight of a new distance
+
 /***************************************************************************************************
  * Type Definitions
  **************************************************************************************************/
 
+// Order in which a tag's antennas are switched during the CTE
+typedef enum {
+  AOA_SWITCH_PATTERN_FIXED = 0,     // Order of the array descriptor
+  AOA_SWITCH_PATTERN_RANDOM = 1,    // Random permutation, drawn for each tag
+  AOA_SWITCH_PATTERN_EXTERNAL = 2   // Configured element list, may be a subset of the array
+} aoa_switch_pattern_mode_t;
+
+// Antenna array geometry and sampling layout of the IQ reports
+typedef struct aoa_array_desc {
+  uint8_t array_type;           // enum sl_rtl_aox_array_type
+  uint8_t num_elements;         // Antennas switched through, one IQ sample each per snapshot
+  uint8_t num_snapshots;
+  uint8_t ref_period_samples;
+  uint8_t switching_pattern[AOA_MAX_ARRAY_ELEMENTS];
+} aoa_array_desc_t;
+
 typedef struct iq_samples {
   float** ref_i_samples;
   float** ref_q_samples;
@@ -110,6 +126,35 @@ typedef struct aoa_libitems {
   uint32_t locator_id;
 } aoa_libitems_t;
 
+// IQ report kept until the tag's channel group is complete
+typedef struct aoa_channel_report {
+  uint8_t len;
+  uint8_t channel;
+  int8_t rssi;
+  uint16_t event_counter;
+  uint8_t samples[AOA_IQ_REPORT_MAX_LEN];
+} aoa_channel_report_t;
+
+// Reports of one tag collected for the next estimate, in a side table of the tag table
+typedef struct aoa_channel_group {
+  uint8_t num_reports;
+  aoa_channel_report_t reports[AOA_NUM_RADIO_CHANNELS];
+} aoa_channel_group_t;
+
+// Per tag state kept between estimates, the estimator itself comes from the shared pool
+typedef struct aoa_tag_state {
+  uint32_t id;          // Owner identifier of leased estimators
+  aoa_channel_group_t *group; // NULL when the angles are not estimated on the locator
+  uint8_t estimator;    // Pool index of the last leased estimator
+  uint8_t warmup;       // Estimates left to smooth after a reset estimator was leased
+  bool filter_valid;
+  float azimuth;
+  float elevation;
+  float distance;
+  uint8_t pattern_len;  // Antennas switched per snapshot
+  uint8_t pattern[AOA_MAX_ARRAY_ELEMENTS]; // Array element indices in switching order
+} aoa_tag_state_t;
+
 // Connection state, used only in connection oriented mode
 typedef enum {
   scanning,
@@ -129,9 +174,23 @@ typedef enum {
  * Function Declarations
  **************************************************************************************************/
 
-void aoa_init(aoa_libitems_t *aoa_state);
-sl_status_t aoa_calculate(aoa_libitems_t *aoa_state, iq_samples_t *iq_samples, aoa_angle_t *angle);
-sl_status_t aoa_deinit(aoa_libitems_t *aoa_state);
+void aoa_init(void);
+// Seed the random switching patterns, after the boot event
+void aoa_start(void);
+const aoa_array_desc_t* aoa_get_array(void);
+void aoa_tag_init(aoa_tag_state_t *tag_state, aoa_channel_group_t *group);
+void aoa_tag_deinit(aoa_tag_state_t *tag_state);
+void aoa_tag_set_pattern(aoa_tag_state_t *tag_state, uint8_t max_elements);
+uint8_t aoa_tag_get_antennas(const aoa_tag_state_t *tag_state, uint8_t *antennas);
+uint8_t aoa_tag_get_report_len(const aoa_tag_state_t *tag_state);
+sl_status_t aoa_convert_iq_report(const aoa_tag_state_t *tag_state, const uint8_t *samples, uint8_t len, uint8_t channel, iq_samples_t *iq_samples);
+sl_status_t aoa_add_report(aoa_tag_state_t *tag_state, const uint8_t *samples, uint8_t len, uint8_t channel, int8_t rssi, uint16_t event_counter);
+sl_status_t aoa_calculate(aoa_tag_state_t *tag_state, aoa_angle_t *angle);
+// Take the tag's complete channel group into a copy of its state, to estimate without the tag
+// table lock. The estimator lease and filter state are kept with aoa_tag_update() afterwards.
+void aoa_tag_snapshot(aoa_tag_state_t *tag_state, aoa_tag_state_t *snapshot, aoa_channel_group_t *group);
+void aoa_tag_update(aoa_tag_state_t *tag_state, const aoa_tag_state_t *snapshot);
+sl_status_t aoa_deinit(void);
 
 /** @} (end addtogroup app) */
 /** @} (end addtogroup Application) */
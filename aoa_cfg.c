@@ -0,0 +1,498 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Locator installation configuration. Settings are loaded from NVM3 at boot, changed over
+ *         the UART command interface and written back to NVM3.
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nvm3_default.h"
+#include "sl_iostream.h"
+#include "sl_rtl_clib_api.h"
+#include "cmd.h"
+#include "conn.h"
+#include "aoa_cfg.h"
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+static aoa_constraints_t constraints;
+static aoa_calibration_t calibration;
+
+// ARRAY_TYPE_* of the antenna array, takes effect at the next boot
+static uint8_t array_id;
+
+static aoa_switch_pattern_t switch_pattern;
+
+// Incremented on every change, estimators created with an older generation get recreated
+static uint8_t generation;
+// The calibration does not touch the estimators, only the conversion tables are reloaded
+static uint8_t cal_generation;
+
+static aoa_cte_config_t cte_config;
+static uint8_t cte_generation;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static sl_status_t constraint_cmd(uint8_t argc, char *argv[]);
+static sl_status_t calibration_cmd(uint8_t argc, char *argv[]);
+static sl_status_t array_cmd(uint8_t argc, char *argv[]);
+static sl_status_t pattern_cmd(uint8_t argc, char *argv[]);
+static sl_status_t cte_cmd(uint8_t argc, char *argv[]);
+static void reset_cte_config(void);
+static bool cte_config_valid(void);
+static int8_t find_cte_tag(const bd_addr *address);
+static void reset_calibration(void);
+static sl_status_t parse_int16(const char *str, int16_t *value);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+void aoa_cfg_init(void)
+{
+  Ecode_t ec;
+
+  // Without a stored configuration the estimator searches the whole hemisphere
+  ec = nvm3_readData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_CONSTRAINTS, &constraints, sizeof(constraints));
+  if (ec != ECODE_NVM3_OK || constraints.count > AOA_CFG_MAX_CONSTRAINTS) {
+    memset(&constraints, 0, sizeof(constraints));
+  }
+
+  // Without a stored calibration every antenna is taken as ideal
+  ec = nvm3_readData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_CALIBRATION, &calibration, sizeof(calibration));
+  if (ec != ECODE_NVM3_OK) {
+    reset_calibration();
+  }
+
+  ec = nvm3_readData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_ARRAY, &array_id, sizeof(array_id));
+  if (ec != ECODE_NVM3_OK || array_id >= ARRAY_TYPE_COUNT) {
+    array_id = ARRAY_TYPE_DEFAULT;
+  }
+
+  // Without a stored pattern the antennas are switched in the order of the array descriptor
+  ec = nvm3_readData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_PATTERN, &switch_pattern, sizeof(switch_pattern));
+  if (ec != ECODE_NVM3_OK || switch_pattern.len > AOA_MAX_ARRAY_ELEMENTS) {
+    memset(&switch_pattern, 0, sizeof(switch_pattern));
+  }
+
+  // Without stored CTE settings every tag gets 1 us slots, one CTE and the whole pattern
+  ec = nvm3_readData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_CTE, &cte_config, sizeof(cte_config));
+  if (ec != ECODE_NVM3_OK || !cte_config_valid()) {
+    reset_cte_config();
+  }
+
+  cmd_register("CONSTRAINT", constraint_cmd);
+  cmd_register("CAL", calibration_cmd);
+  cmd_register("ARRAY", array_cmd);
+  cmd_register("PATTERN", pattern_cmd);
+  cmd_register("CTE", cte_cmd);
+}
+
+const aoa_constraints_t* aoa_cfg_get_constraints(void)
+{
+  return &constraints;
+}
+
+const aoa_calibration_t* aoa_cfg_get_calibration(void)
+{
+  return &calibration;
+}
+
+uint8_t aoa_cfg_get_generation(void)
+{
+  return generation;
+}
+
+uint8_t aoa_cfg_get_cal_generation(void)
+{
+  return cal_generation;
+}
+
+uint8_t aoa_cfg_get_array_id(void)
+{
+  return array_id;
+}
+
+const aoa_switch_pattern_t* aoa_cfg_get_switch_pattern(void)
+{
+  return &switch_pattern;
+}
+
+const aoa_cte_profile_t* aoa_cfg_get_cte_profile(const bd_addr *address)
+{
+  int8_t tag = find_cte_tag(address);
+
+  return &cte_config.profiles[(tag < 0) ? 0 : cte_config.tags[tag].profile];
+}
+
+uint8_t aoa_cfg_get_cte_generation(void)
+{
+  return cte_generation;
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// $CONSTRAINT                        list the stored constraints
+// $CONSTRAINT,CLEAR                  remove all constraints
+// $CONSTRAINT,<AZ|EL>,<min>,<max>    limit azimuth or elevation to [min, max] degrees
+// Changes apply to each pooled estimator on its next use.
+static sl_status_t constraint_cmd(uint8_t argc, char *argv[])
+{
+  char str[48];
+  aoa_constraint_t constraint;
+
+  if (argc == 1) {
+    for (uint8_t i = 0; i < constraints.count; i++) {
+      sprintf(str, "$CONSTRAINT,%s,%d,%d\n",
+              (constraints.items[i].type == SL_RTL_AOX_CONSTRAINT_TYPE_AZIMUTH) ? "AZ" : "EL",
+              constraints.items[i].min_value,
+              constraints.items[i].max_value);
+      sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    }
+    return SL_STATUS_OK;
+  }
+
+  if (argc == 2 && strcmp(argv[1], "CLEAR") == 0) {
+    constraints.count = 0;
+  } else if (argc == 4) {
+    if (strcmp(argv[1], "AZ") == 0) {
+      constraint.type = SL_RTL_AOX_CONSTRAINT_TYPE_AZIMUTH;
+    } else if (strcmp(argv[1], "EL") == 0) {
+      constraint.type = SL_RTL_AOX_CONSTRAINT_TYPE_ELEVATION;
+    } else {
+      return SL_STATUS_INVALID_PARAMETER;
+    }
+    if (parse_int16(argv[2], &constraint.min_value) != SL_STATUS_OK
+        || parse_int16(argv[3], &constraint.max_value) != SL_STATUS_OK
+        || constraint.min_value >= constraint.max_value) {
+      return SL_STATUS_INVALID_PARAMETER;
+    }
+    if ((constraint.type == SL_RTL_AOX_CONSTRAINT_TYPE_AZIMUTH && (constraint.min_value < -180 || constraint.max_value > 360))
+        || (constraint.type == SL_RTL_AOX_CONSTRAINT_TYPE_ELEVATION && (constraint.min_value < 0 || constraint.max_value > 90))) {
+      return SL_STATUS_INVALID_RANGE;
+    }
+    if (constraints.count >= AOA_CFG_MAX_CONSTRAINTS) {
+      return SL_STATUS_FULL;
+    }
+    constraints.items[constraints.count++] = constraint;
+  } else {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  generation++;
+
+  if (nvm3_writeData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_CONSTRAINTS, &constraints, sizeof(constraints)) != ECODE_NVM3_OK) {
+    return SL_STATUS_FAIL;
+  }
+  return SL_STATUS_OK;
+}
+
+// $CAL                                            list the calibration table
+// $CAL,CLEAR                                      reset all antennas to ideal
+// $CAL,<channel group>,<antenna>,<phase>,<gain>   phase in 1/100 degrees, gain in 1/1000
+// Changes apply from the next IQ conversion, the estimators and their filter state are kept.
+static sl_status_t calibration_cmd(uint8_t argc, char *argv[])
+{
+  char str[48];
+  int16_t group;
+  int16_t antenna;
+  aoa_cal_entry_t entry;
+
+  if (argc == 1) {
+    for (group = 0; group < AOA_CAL_CHANNEL_GROUPS; group++) {
+      for (antenna = 0; antenna < aoa_get_array()->num_elements; antenna++) {
+        sprintf(str, "$CAL,%d,%d,%d,%d\n",
+                group,
+                antenna,
+                calibration.entries[group][antenna].phase,
+                calibration.entries[group][antenna].gain);
+        sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+      }
+    }
+    return SL_STATUS_OK;
+  }
+
+  if (argc == 2 && strcmp(argv[1], "CLEAR") == 0) {
+    reset_calibration();
+  } else if (argc == 5) {
+    if (parse_int16(argv[1], &group) != SL_STATUS_OK
+        || parse_int16(argv[2], &antenna) != SL_STATUS_OK
+        || parse_int16(argv[3], &entry.phase) != SL_STATUS_OK
+        || parse_int16(argv[4], &entry.gain) != SL_STATUS_OK) {
+      return SL_STATUS_INVALID_PARAMETER;
+    }
+    if (group < 0 || group >= AOA_CAL_CHANNEL_GROUPS
+        || antenna < 0 || antenna >= aoa_get_array()->num_elements
+        || entry.gain <= 0) {
+      return SL_STATUS_INVALID_RANGE;
+    }
+    calibration.entries[group][antenna] = entry;
+  } else {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  cal_generation++;
+
+  if (nvm3_writeData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_CALIBRATION, &calibration, sizeof(calibration)) != ECODE_NVM3_OK) {
+    return SL_STATUS_FAIL;
+  }
+  return SL_STATUS_OK;
+}
+
+// $ARRAY          print the selected array id and the layout of the array in use
+// $ARRAY,<id>     select the array for the next boot: 0 = 4x4 URA, 1 = 3x3 URA, 2 = 1x4 ULA
+// Buffers, estimators and the CTE switching pattern are set up for one array at boot, so a
+// change needs a reset.
+static sl_status_t array_cmd(uint8_t argc, char *argv[])
+{
+  char str[48];
+  const aoa_array_desc_t *array = aoa_get_array();
+  int16_t id;
+
+  if (argc == 1) {
+    sprintf(str, "$ARRAY,%d,%d,%d,%d\n",
+            array_id,
+            array->num_elements,
+            array->num_snapshots,
+            array->ref_period_samples);
+    sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    return SL_STATUS_OK;
+  }
+
+  if (argc != 2 || parse_int16(argv[1], &id) != SL_STATUS_OK) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  if (id < 0 || id >= ARRAY_TYPE_COUNT) {
+    return SL_STATUS_INVALID_RANGE;
+  }
+  array_id = (uint8_t)id;
+
+  if (nvm3_writeData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_ARRAY, &array_id, sizeof(array_id)) != ECODE_NVM3_OK) {
+    return SL_STATUS_FAIL;
+  }
+  return SL_STATUS_OK;
+}
+
+// $PATTERN                         print the switching pattern mode and external element list
+// $PATTERN,FIXED                   switch in the order of the array descriptor
+// $PATTERN,RANDOM                  switch in a random order drawn for each tag
+// $PATTERN,EXT,<element>,...       switch the given array elements in the given order, a subset
+//                                  shortens the IQ reports but leaves estimation to the host
+// Tags pick up a change when they are synchronized the next time.
+static sl_status_t pattern_cmd(uint8_t argc, char *argv[])
+{
+  char str[16];
+  aoa_switch_pattern_t pattern;
+  int16_t element;
+  uint32_t used = 0;
+
+  if (argc == 1) {
+    sprintf(str, "$PATTERN,%u", switch_pattern.mode);
+    sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    for (uint8_t i = 0; i < switch_pattern.len; i++) {
+      sprintf(str, ",%u", switch_pattern.elements[i]);
+      sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    }
+    sl_iostream_write(SL_IOSTREAM_STDOUT, "\n", 1);
+    return SL_STATUS_OK;
+  }
+
+  memset(&pattern, 0, sizeof(pattern));
+  if (argc == 2 && strcmp(argv[1], "FIXED") == 0) {
+    pattern.mode = AOA_SWITCH_PATTERN_FIXED;
+  } else if (argc == 2 && strcmp(argv[1], "RANDOM") == 0) {
+    pattern.mode = AOA_SWITCH_PATTERN_RANDOM;
+  } else if (argc >= 3 && strcmp(argv[1], "EXT") == 0) {
+    pattern.mode = AOA_SWITCH_PATTERN_EXTERNAL;
+    if (argc - 2 > aoa_get_array()->num_elements) {
+      return SL_STATUS_INVALID_RANGE;
+    }
+    for (uint8_t i = 2; i < argc; i++) {
+      if (parse_int16(argv[i], &element) != SL_STATUS_OK) {
+        return SL_STATUS_INVALID_PARAMETER;
+      }
+      // Each element at most once
+      if (element < 0 || element >= aoa_get_array()->num_elements || (used & (1UL << element)) != 0) {
+        return SL_STATUS_INVALID_RANGE;
+      }
+      used |= 1UL << element;
+      pattern.elements[pattern.len++] = (uint8_t)element;
+    }
+  } else {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  switch_pattern = pattern;
+
+  if (nvm3_writeData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_PATTERN, &switch_pattern, sizeof(switch_pattern)) != ECODE_NVM3_OK) {
+    return SL_STATUS_FAIL;
+  }
+  return SL_STATUS_OK;
+}
+
+// $CTE                                            list the profiles, then the assigned tags
+// $CTE,<profile>,<slot us>,<count>,<elements>     set a profile: 1 or 2 us slots, CTEs per
+//                                                 advertisement, leading pattern elements or 0
+// $CTE,TAG,<tag id>,<profile>                     assign a tag, profile 0 removes the assignment
+// Synced tags re-apply a change with their next IQ report, the sync is kept.
+static sl_status_t cte_cmd(uint8_t argc, char *argv[])
+{
+  char str[48];
+  aoa_cte_profile_t profile;
+  bd_addr address;
+  int16_t index;
+  int16_t count;
+  int16_t elements;
+  int16_t slot;
+  uint64_t id;
+  char *end;
+  int8_t tag;
+
+  if (argc == 1) {
+    for (uint8_t i = 0; i < AOA_CFG_CTE_PROFILES; i++) {
+      sprintf(str, "$CTE,%u,%u,%u,%u\n",
+              i,
+              cte_config.profiles[i].slot_duration,
+              cte_config.profiles[i].cte_count,
+              cte_config.profiles[i].max_elements);
+      sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    }
+    for (uint8_t i = 0; i < cte_config.tag_count; i++) {
+      sprintf(str, "$CTE,TAG,%llu,%u\n",
+              conn_address_to_id(&cte_config.tags[i].address),
+              cte_config.tags[i].profile);
+      sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    }
+    return SL_STATUS_OK;
+  }
+
+  if (argc == 4 && strcmp(argv[1], "TAG") == 0) {
+    id = strtoull(argv[2], &end, 10);
+    if (end == argv[2] || *end != '\0' || parse_int16(argv[3], &index) != SL_STATUS_OK) {
+      return SL_STATUS_INVALID_PARAMETER;
+    }
+    if (index < 0 || index >= AOA_CFG_CTE_PROFILES) {
+      return SL_STATUS_INVALID_RANGE;
+    }
+    memset(&address, 0, sizeof(address));
+    conn_id_to_address(id, &address);
+    tag = find_cte_tag(&address);
+    if (index == 0) {
+      if (tag < 0) {
+        return SL_STATUS_NOT_FOUND;
+      }
+      cte_config.tags[tag] = cte_config.tags[--cte_config.tag_count];
+    } else {
+      if (tag < 0) {
+        if (cte_config.tag_count >= AOA_CFG_MAX_CTE_TAGS) {
+          return SL_STATUS_FULL;
+        }
+        tag = (int8_t)cte_config.tag_count++;
+        cte_config.tags[tag].address = address;
+      }
+      cte_config.tags[tag].profile = (uint8_t)index;
+    }
+  } else if (argc == 5) {
+    if (parse_int16(argv[1], &index) != SL_STATUS_OK
+        || parse_int16(argv[2], &slot) != SL_STATUS_OK
+        || parse_int16(argv[3], &count) != SL_STATUS_OK
+        || parse_int16(argv[4], &elements) != SL_STATUS_OK) {
+      return SL_STATUS_INVALID_PARAMETER;
+    }
+    // At least two antennas to switch between
+    if (index < 0 || index >= AOA_CFG_CTE_PROFILES
+        || (slot != 1 && slot != 2)
+        || count < 1 || count > AOA_CFG_MAX_CTE_COUNT
+        || (elements != 0 && (elements < 2 || elements > aoa_get_array()->num_elements))) {
+      return SL_STATUS_INVALID_RANGE;
+    }
+    profile.slot_duration = (uint8_t)slot;
+    profile.cte_count = (uint8_t)count;
+    profile.max_elements = (uint8_t)elements;
+    cte_config.profiles[index] = profile;
+  } else {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  cte_generation++;
+
+  if (nvm3_writeData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_CTE, &cte_config, sizeof(cte_config)) != ECODE_NVM3_OK) {
+    return SL_STATUS_FAIL;
+  }
+  return SL_STATUS_OK;
+}
+
+static void reset_cte_config(void)
+{
+  memset(&cte_config, 0, sizeof(cte_config));
+  for (uint8_t i = 0; i < AOA_CFG_CTE_PROFILES; i++) {
+    cte_config.profiles[i].slot_duration = 1;
+    cte_config.profiles[i].cte_count = 1;
+  }
+}
+
+static bool cte_config_valid(void)
+{
+  if (cte_config.tag_count > AOA_CFG_MAX_CTE_TAGS) {
+    return false;
+  }
+  for (uint8_t i = 0; i < AOA_CFG_CTE_PROFILES; i++) {
+    if ((cte_config.profiles[i].slot_duration != 1 && cte_config.profiles[i].slot_duration != 2)
+        || cte_config.profiles[i].cte_count < 1
+        || cte_config.profiles[i].cte_count > AOA_CFG_MAX_CTE_COUNT) {
+      return false;
+    }
+  }
+  for (uint8_t i = 0; i < cte_config.tag_count; i++) {
+    if (cte_config.tags[i].profile >= AOA_CFG_CTE_PROFILES) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Assigned tags are few and only looked up when a sync opens or the settings change
+static int8_t find_cte_tag(const bd_addr *address)
+{
+  for (uint8_t i = 0; i < cte_config.tag_count; i++) {
+    if (0 == memcmp(address, &cte_config.tags[i].address, sizeof(bd_addr))) {
+      return (int8_t)i;
+    }
+  }
+  return -1;
+}
+
+static void reset_calibration(void)
+{
+  for (uint8_t group = 0; group < AOA_CAL_CHANNEL_GROUPS; group++) {
+    for (uint8_t antenna = 0; antenna < AOA_MAX_ARRAY_ELEMENTS; antenna++) {
+      calibration.entries[group][antenna].phase = 0;
+      calibration.entries[group][antenna].gain = AOA_CAL_GAIN_SCALE;
+    }
+  }
+}
+
+static sl_status_t parse_int16(const char *str, int16_t *value)
+{
+  char *end;
+  long result = strtol(str, &end, 10);
+
+  if (end == str || *end != '\0' || result < INT16_MIN || result > INT16_MAX) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  *value = (int16_t)result;
+  return SL_STATUS_OK;
+}
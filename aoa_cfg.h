@@ -0,0 +1,148 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Locator installation configuration header file
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef AOA_CFG_H
+#define AOA_CFG_H
+
+#include <stdint.h>
+#include "sl_status.h"
+#include "aoa.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************************************//**
+ * @addtogroup Application
+ * @{
+ **************************************************************************************************/
+
+/***********************************************************************************************//**
+ * @addtogroup app
+ * @{
+ **************************************************************************************************/
+
+// NVM3 keys of the application, 0x00000 - 0x0FFFF is the user range of the default instance
+#define AOA_CFG_NVM3_KEY_CONSTRAINTS  (0x01000)
+#define AOA_CFG_NVM3_KEY_CALIBRATION  (0x01001)
+#define AOA_CFG_NVM3_KEY_ARRAY        (0x01002)
+#define AOA_CFG_NVM3_KEY_PATTERN      (0x01003)
+#define AOA_CFG_NVM3_KEY_EVICTION     (0x01004)
+#define AOA_CFG_NVM3_KEY_TAG_CACHE    (0x01005)
+#define AOA_CFG_NVM3_KEY_ALLOW_LIST   (0x01006)
+#define AOA_CFG_NVM3_KEY_DENY_LIST    (0x01007)
+#define AOA_CFG_NVM3_KEY_IQ_BUDGET    (0x01008)
+#define AOA_CFG_NVM3_KEY_CTE          (0x01009)
+#define AOA_CFG_NVM3_KEY_SCAN_PHY     (0x0100A)
+
+#define AOA_CFG_MAX_CONSTRAINTS       4
+
+// Calibration tables: 1 applies to all channels, 40 gives one per channel. The table must fit in
+// an NVM3 object, AOA_CAL_CHANNEL_GROUPS * AOA_MAX_ARRAY_ELEMENTS * 4 <= NVM3_DEFAULT_MAX_OBJECT_SIZE
+#define AOA_CAL_CHANNEL_GROUPS        1
+#define AOA_CAL_PHASE_SCALE           100   // Phase offsets in 1/100 degrees
+#define AOA_CAL_GAIN_SCALE            1000  // Gain factors in 1/1000
+
+// CTE receive profiles, profile 0 applies to every tag not assigned to another one
+#define AOA_CFG_CTE_PROFILES          4
+#define AOA_CFG_MAX_CTE_TAGS          16
+#define AOA_CFG_MAX_CTE_COUNT         16    // CTEs sampled per periodic advertisement
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+// Angle range the estimator is limited to, in degrees
+typedef struct {
+  uint8_t type;         // enum sl_rtl_aox_constraint_type
+  int16_t min_value;
+  int16_t max_value;
+} aoa_constraint_t;
+
+typedef struct {
+  uint8_t count;
+  aoa_constraint_t items[AOA_CFG_MAX_CONSTRAINTS];
+} aoa_constraints_t;
+
+// Complex correction of one antenna, multiplied onto its IQ samples
+typedef struct {
+  int16_t phase;
+  int16_t gain;
+} aoa_cal_entry_t;
+
+typedef struct {
+  aoa_cal_entry_t entries[AOA_CAL_CHANNEL_GROUPS][AOA_MAX_ARRAY_ELEMENTS];
+} aoa_calibration_t;
+
+// Antenna switching applied to tags when they get synchronized
+typedef struct {
+  uint8_t mode;         // aoa_switch_pattern_mode_t
+  uint8_t len;          // Used in external mode only
+  uint8_t elements[AOA_MAX_ARRAY_ELEMENTS];
+} aoa_switch_pattern_t;
+
+// Trades the IQ bytes and processing per report against accuracy
+typedef struct {
+  uint8_t slot_duration;  // Switching and sampling slots in us, 1 or 2. 2 us slots halve the
+                          // samples of a CTE, fewer than the on-locator estimator needs.
+  uint8_t cte_count;      // CTEs sampled per periodic advertisement, one IQ report each
+  uint8_t max_elements;   // Leading antennas of the switching pattern used, 0 for all. Fewer
+                          // shorten the reports but leave estimation to the host.
+} aoa_cte_profile_t;
+
+typedef struct {
+  bd_addr address;
+  uint8_t profile;
+} aoa_cte_tag_t;
+
+// NVM3 object of the CTE settings
+typedef struct {
+  aoa_cte_profile_t profiles[AOA_CFG_CTE_PROFILES];
+  uint8_t tag_count;
+  aoa_cte_tag_t tags[AOA_CFG_MAX_CTE_TAGS];
+} aoa_cte_config_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void aoa_cfg_init(void);
+
+const aoa_constraints_t* aoa_cfg_get_constraints(void);
+
+const aoa_calibration_t* aoa_cfg_get_calibration(void);
+
+// Incremented on every change of the constraints, estimators are recreated when it differs
+uint8_t aoa_cfg_get_generation(void);
+
+// Incremented on every change of the calibration, which is applied in the IQ conversion
+uint8_t aoa_cfg_get_cal_generation(void);
+
+uint8_t aoa_cfg_get_array_id(void);
+
+const aoa_switch_pattern_t* aoa_cfg_get_switch_pattern(void);
+
+// Profile the tag is assigned to, profile 0 if none
+const aoa_cte_profile_t* aoa_cfg_get_cte_profile(const bd_addr *address);
+
+// Incremented on every change of the CTE settings, running syncs re-apply them when it differs
+uint8_t aoa_cfg_get_cte_generation(void);
+
+/** @} (end addtogroup app) */
+/** @} (end addtogroup Application) */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* AOA_CFG_H */
@@ -31,6 +31,7 @@ typedef struct aoa_angle_s {
   int16_t rssi;
   uint16_t channel;
   int32_t sequence;
+  uint8_t confidence;   // 0 (unusable) ... 100 (clean measurement)
 } aoa_angle_t;
 
 typedef struct aoa_position_s {
@@ -15,11 +15,23 @@
  *
  ******************************************************************************/
 #include "em_common.h"
+#include "sl_component_catalog.h"
 #include "sl_app_assert.h"
 #include "sl_bluetooth.h"
 #include "gatt_db.h"
 #include "app.h"
 #include "conn.h"
+#include "sched.h"
+#include "sync_sched.h"
+#include "timer_wheel.h"
+#include "tag_filter.h"
+#include "ad_parser.h"
+#include "scan_policy.h"
+#include "cmd.h"
+#include "aoa_cfg.h"
+#if defined(SL_CATALOG_KERNEL_PRESENT)
+#include "app_rtos.h"
+#endif
 #include <stdio.h>
 #include <string.h>
 #include "sl_iostream.h"
@@ -29,59 +41,57 @@
 
 #define sl_app_log(...)
 
+// The DSP task of the kernel build reads the tag table while the Bluetooth task changes it
+#if defined(SL_CATALOG_KERNEL_PRESENT)
+#define TAG_TABLE_LOCK()    app_rtos_tag_table_lock()
+#define TAG_TABLE_UNLOCK()  app_rtos_tag_table_unlock()
+#else
+#define TAG_TABLE_LOCK()
+#define TAG_TABLE_UNLOCK()
+#endif
+
+// Scan reports by the stage of the fast path that ended their handling, see handle_scan_report()
+typedef struct {
+  uint32_t not_extended;  // Legacy advertisements, tags only use extended ones
+  uint32_t filtered;      // Denied or not on the allow list
+  uint32_t known;         // Tags already known to the sync scheduler
+  uint32_t no_service;    // Payload without any of the tag patterns
+  uint32_t new_tags;      // Handed to the sync scheduler
+} scan_stats_t;
+
 // Static variables
 static bd_addr self_address;
 static uint8_t address_type = 0;
+static scan_stats_t scan_stats;
+static timer_wheel_timer_t scan_report_timer;
+#if defined(SL_CATALOG_KERNEL_PRESENT)
+static timer_wheel_timer_t cmd_timer;
+#endif
 
-// UUIDs defined by Bluetooth SIG
-static const uint8_t cte_service[SERVICE_UUID_LEN] = { 0x50, 0x69, 0x96, 0x81, 0xb7, 0xa8, 0xad, 0x07, 0x96, 0xf2, 0x3f, 0x07, 0x64, 0x36, 0xd0, 0x0e };
-
-// Antenna switching pattern
-static const uint8_t antenna_array[NUM_ANTENNAS] = SWITCHING_PATTERN;
-
-uint8_t find_service_in_advertisement(uint8_t *advdata, uint8_t advlen, uint8_t *service_uuid)
-{
-  uint8_t ad_field_length;
-  uint8_t ad_field_type;
-  uint8_t *ad_uuid_field;
-  uint32_t i = 0;
-  uint32_t next_ad_structure;
-  uint8_t ret = 0;
-
-  // Parse advertisement packet
-  while (i < advlen) {
-    ad_field_length = advdata[i];
-    ad_field_type = advdata[i + 1];
-    next_ad_structure = i + ad_field_length + 1;
-    // incomplete or complete UUIDs
-    if (ad_field_type == AD_FIELD_I || ad_field_type == AD_FIELD_C) {
-      // compare UUID to the service UUID to be found
-      for (ad_uuid_field = advdata + i + 2; ad_uuid_field < advdata + next_ad_structure; ad_uuid_field += SERVICE_UUID_LEN) {
-        if (memcmp(ad_uuid_field, service_uuid, SERVICE_UUID_LEN) == 0) {
-          ret = 1;
-          break;
-        }
-      }
-      if (ret == 1) {
-        break;
-      }
-    }
-    // advance to the next AD struct
-    i = next_ad_structure;
-  }
-  return ret;
-}
+// Advertisements of tags, any of the patterns. UUIDs defined by Bluetooth SIG.
+static const ad_pattern_t tag_patterns[] = {
+  // CTE service
+  { AD_PATTERN_SERVICE_UUID, SERVICE_UUID_LEN, { 0x50, 0x69, 0x96, 0x81, 0xb7, 0xa8, 0xad, 0x07, 0x96, 0xf2, 0x3f, 0x07, 0x64, 0x36, 0xd0, 0x0e } },
+};
+static ad_pattern_set_t tag_pattern_set;
+
+// Static function declarations
+static void process_iq_report(conn_properties_t *tag);
+static void handle_scan_report(sl_bt_evt_scanner_scan_report_t *report);
+static void scan_report_timer_cb(timer_wheel_timer_t *timer, void *data);
+#if defined(SL_CATALOG_KERNEL_PRESENT)
+static void cmd_timer_cb(timer_wheel_timer_t *timer, void *data);
+#endif
+static sl_status_t start_cte_receiver(conn_properties_t *tag);
 
-void app_iq_samples_ready(conn_properties_t *tag, uint8_t* iq_samples, uint8_t slen, int8_t rssi, uint8_t channel, uint16_t event_counter)
+void app_iq_samples_ready(bd_addr *tag_address, uint8_t* iq_samples, uint8_t slen, int8_t rssi, uint8_t channel, uint16_t event_counter)
 {
   char str[200];
   uint32_t ms = sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count());
 
   // Convert Bluetooth addresses to decimal representation
-  uint64_t locator_id = ((uint64_t)self_address.addr[0]) | ((uint64_t)self_address.addr[1] << 8) | ((uint64_t)self_address.addr[2] << 16)
-      | ((uint64_t)self_address.addr[3] << 24) | ((uint64_t)self_address.addr[4] << 32) | ((uint64_t)self_address.addr[5] << 40);
-  uint64_t tag_id = ((uint64_t)tag->address.addr[0]) | ((uint64_t)tag->address.addr[1] << 8) | ((uint64_t)tag->address.addr[2] << 16)
-      | ((uint64_t)tag->address.addr[3] << 24) | ((uint64_t)tag->address.addr[4] << 32) | ((uint64_t)tag->address.addr[5] << 40);
+  uint64_t locator_id = conn_address_to_id(&self_address);
+  uint64_t tag_id = conn_address_to_id(tag_address);
 
   // Send data in ASCII format, as
   // $IQ,<cte rx dev-id>,<cte tx dev-id>,<timestamp_ms>,<seq_num>,<ble_chan>,<rssi>,
@@ -103,6 +113,158 @@ void app_iq_samples_ready(conn_properties_t *tag, uint8_t* iq_samples, uint8_t s
   }
 }
 
+void app_pattern_ready(bd_addr *tag_address, aoa_tag_state_t *tag_state)
+{
+  char str[64];
+
+  // Send the switching order of the tag's IQ samples in ASCII format, as
+  // $SWITCH,<cte rx dev-id>,<cte tx dev-id>,<element>,...,<element>\n
+  sprintf(str, "$SWITCH,%llu,%llu",
+          conn_address_to_id(&self_address),
+          conn_address_to_id(tag_address));
+  sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+  for (uint8_t i = 0; i < tag_state->pattern_len; i++) {
+    sprintf(str, ",%u", tag_state->pattern[i]);
+    sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+  }
+  sl_iostream_write(SL_IOSTREAM_STDOUT, "\n", 1);
+}
+
+void app_angle_ready(bd_addr *tag_address, aoa_angle_t *angle)
+{
+  char str[200];
+  uint32_t ms = sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count());
+
+  // Send data in ASCII format, angles in 1/100 degrees and distance in cm, as
+  // $ANGLE,<cte rx dev-id>,<cte tx dev-id>,<timestamp_ms>,<seq_num>,<ble_chan>,<rssi>,<azimuth>,<elevation>,<distance>,<confidence>\n
+  sprintf(str, "$ANGLE,%llu,%llu,%lu,%ld,%u,%d,%ld,%ld,%ld,%u\n",
+          conn_address_to_id(&self_address),
+          conn_address_to_id(tag_address),
+          ms,
+          angle->sequence,
+          angle->channel,
+          angle->rssi,
+          (int32_t)(angle->azimuth * 100.0f),
+          (int32_t)(angle->elevation * 100.0f),
+          (int32_t)(angle->distance * 100.0f),
+          angle->confidence);
+  sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+}
+
+sl_status_t app_calculate_angle(conn_properties_t *tag, iq_report_t *report, aoa_angle_t *angle)
+{
+  sl_status_t sc;
+
+  // Reports are collected until the tag's channel group is complete
+  sc = aoa_add_report(conn_aoa_state(tag), report->samples, report->len, report->channel, report->rssi, report->event_counter);
+  if (sc != SL_STATUS_OK) {
+    return sc;
+  }
+
+  return aoa_calculate(conn_aoa_state(tag), angle);
+}
+
+static void process_iq_report(conn_properties_t *tag)
+{
+  iq_report_t *report = conn_iq_report(tag);
+#if AOA_ESTIMATION_ON_DEVICE
+  aoa_angle_t angle;
+
+  if (app_calculate_angle(tag, report, &angle) == SL_STATUS_OK) {
+    app_angle_ready(&tag->address, &angle);
+  }
+#else
+  app_iq_samples_ready(&tag->address, report->samples, report->len, report->rssi, report->channel, report->event_counter);
+#endif
+}
+
+// Cheapest checks first. Most advertisers are not tags, the parse rejects them sooner than the
+// lookup of the known tags would, see test/host/bench_scan_report.c.
+static void handle_scan_report(sl_bt_evt_scanner_scan_report_t *report)
+{
+  // Tags advertise their periodic train with extended advertisements
+  if (!(report->packet_type & 0x80)) {
+    scan_stats.not_extended++;
+    return;
+  }
+
+  // Denied or not allowed advertisers, on the address alone
+  if (!tag_filter_accept(&report->address)) {
+    scan_stats.filtered++;
+    return;
+  }
+
+  // Without any of the tag patterns, the parser stops at malformed data
+  if (ad_parser_match(report->data.data, report->data.len, &tag_pattern_set) == 0) {
+    scan_stats.no_service++;
+    return;
+  }
+
+  // Known tags, whether synced or waiting
+  if (sync_sched_seen(&report->address, report->address_type, report->rssi) != NULL) {
+    scan_stats.known++;
+    return;
+  }
+
+  // The sync scheduler syncs the tag when a sync is free or its turn comes
+  if (sync_sched_add(&report->address, report->address_type, report->adv_sid, report->rssi) != NULL) {
+    scan_stats.new_tags++;
+    scan_policy_tag_found();
+    sl_app_log("CTE service is found...\n");
+  }
+}
+
+static void scan_report_timer_cb(timer_wheel_timer_t *timer, void *data)
+{
+  char str[80];
+
+  (void)timer;
+  (void)data;
+
+  // $SCAN,<legacy>,<filtered>,<known tags>,<no CTE service>,<new tags>, counts per interval
+  sprintf(str, "$SCAN,%lu,%lu,%lu,%lu,%lu\n",
+          scan_stats.not_extended,
+          scan_stats.filtered,
+          scan_stats.known,
+          scan_stats.no_service,
+          scan_stats.new_tags);
+  sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+  memset(&scan_stats, 0, sizeof(scan_stats));
+}
+
+#if defined(SL_CATALOG_KERNEL_PRESENT)
+static void cmd_timer_cb(timer_wheel_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+
+  cmd_process();
+}
+#endif
+
+// Receive the tag's CTEs with the settings of its profile, also to re-apply changed settings
+static sl_status_t start_cte_receiver(conn_properties_t *tag)
+{
+  const aoa_cte_profile_t *profile = aoa_cfg_get_cte_profile(&tag->address);
+  uint8_t antennas[AOA_MAX_ARRAY_ELEMENTS];
+  uint8_t antenna_count;
+
+  tag->cte_generation = aoa_cfg_get_cte_generation();
+
+  // Draw the tag's switching pattern, the host needs it to interpret the IQ samples
+  TAG_TABLE_LOCK();
+  aoa_tag_set_pattern(conn_aoa_state(tag), profile->max_elements);
+  antenna_count = aoa_tag_get_antennas(conn_aoa_state(tag), antennas);
+  TAG_TABLE_UNLOCK();
+  app_pattern_ready(&tag->address, conn_aoa_state(tag));
+
+  return sl_bt_cte_receiver_enable_connectionless_cte(tag->connection_handle,
+                                                      profile->slot_duration,
+                                                      profile->cte_count,
+                                                      antenna_count,
+                                                      antennas);
+}
+
 /**************************************************************************//**
  * Application Init.
  *****************************************************************************/
@@ -113,6 +275,37 @@ SL_WEAK void app_init(void)
   setvbuf(stdout, NULL, _IONBF, 0);   /*Set unbuffered mode for stdout (newlib)*/
   setvbuf(stdin, NULL, _IONBF, 0);   /*Set unbuffered mode for stdin (newlib)*/
 #endif
+
+  // Tag table, all slots free
+  init_connection();
+
+  // Installation configuration, changeable over the UART
+  cmd_init();
+  aoa_cfg_init();
+
+  // Shared estimator pool, created with the stored configuration
+  aoa_init();
+
+  // Periodic advertising syncs rotated among the known tags
+  timer_wheel_init();
+  tag_filter_init();
+  sync_sched_init();
+  scan_policy_init();
+  ad_parser_set_init(&tag_pattern_set, tag_patterns, sizeof(tag_patterns) / sizeof(tag_patterns[0]));
+  timer_wheel_start(&scan_report_timer,
+                    SCAN_REPORT_INTERVAL_MS,
+                    SCAN_REPORT_INTERVAL_MS,
+                    scan_report_timer_cb,
+                    NULL);
+
+#if defined(SL_CATALOG_KERNEL_PRESENT)
+  // Bluetooth event intake, DSP and output run as separate tasks
+  app_rtos_init();
+  // There is no super loop, commands are handled in the Bluetooth task like the other timers
+  timer_wheel_start(&cmd_timer, CMD_POLL_INTERVAL_MS, CMD_POLL_INTERVAL_MS, cmd_timer_cb, NULL);
+#else
+  sched_init(process_iq_report);
+#endif
 }
 
 /**************************************************************************//**
@@ -125,7 +318,23 @@ SL_WEAK void app_process_action(void)
   // This is called infinitely.                                              //
   // Do not call blocking functions from here!                               //
   /////////////////////////////////////////////////////////////////////////////
+
+  // Process the next pending IQ report within the CPU budget
+  sched_step();
+
+  // Handle configuration commands from the host
+  cmd_process();
+}
+
+#if defined(SL_CATALOG_POWER_MANAGER_PRESENT) && !defined(SL_CATALOG_KERNEL_PRESENT)
+/**************************************************************************//**
+ * Keep the CPU awake while IQ reports are waiting to be processed.
+ *****************************************************************************/
+bool app_is_ok_to_sleep(void)
+{
+  return !sched_is_work_ready();
 }
+#endif // SL_CATALOG_POWER_MANAGER_PRESENT && !SL_CATALOG_KERNEL_PRESENT
 
 /**************************************************************************//**
  * Bluetooth stack event handler.
@@ -153,98 +362,77 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
                  "[E: 0x%04x] Failed to get bt address\n",
                  (int)sc);
 
-      sc = sl_bt_scanner_set_mode(gap_1m_phy, SCAN_PASSIVE);
+      // On both primary PHYs, the scan policy selects the ones scanned
+      sc = sl_bt_scanner_set_mode(gap_1m_phy | gap_coded_phy, SCAN_PASSIVE);
       sl_app_assert(sc == SL_STATUS_OK,
                  "[E: 0x%04x] Failed to set scanner mode\n",
                  (int)sc);
 
-      // Set scan interval and scan window
-      sc = sl_bt_scanner_set_timing(gap_1m_phy, SCAN_INTERVAL, SCAN_WINDOW);
-      sl_app_assert(sc == SL_STATUS_OK,
-                 "[E: 0x%04x] Failed to set scanner timing\n",
-                 (int)sc);
+      // Random switching patterns are drawn from the first sync on
+      aoa_start();
 
-      // Start scanning - looking for tags
-      sc = sl_bt_scanner_start(gap_1m_phy, scanner_discover_observation);
-      sl_app_assert(sc == SL_STATUS_OK,
-                 "[E: 0x%04x] Failed to start scanner\n",
-                 (int)sc);
+      // Start scanning - looking for tags, with the duty cycle following the syncs
+      scan_policy_start();
+
+      // Let the controller drop advertisers that are not allowed, where it can
+      tag_filter_start();
+
+      // Resync the tags tracked before the reset, directly from the tag cache
+      sync_sched_start();
     } break;
 
 
     case sl_bt_evt_scanner_scan_report_id:
     {
-      // Parse extended advertisement packets
-      if (evt->data.evt_scanner_scan_report.packet_type & 0x80) {
-        // If a CTE service is found...
-
-
-
-        uint16_t sync_handle;
-        conn_properties_t *tag;
-        if (find_service_in_advertisement(&(evt->data.evt_scanner_scan_report.data.data[0]),
-                                          evt->data.evt_scanner_scan_report.data.len,
-                                          (uint8_t *) cte_service) != 0) {
-
-
-            sprintf(str,"CTE service is found...\n\r");
-            sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
-
-
-          // ...then sync on the periodic advertisement
-          sc = sl_bt_sync_open(evt->data.evt_scanner_scan_report.address,
-                               evt->data.evt_scanner_scan_report.address_type,
-                               evt->data.evt_scanner_scan_report.adv_sid,
-                               &sync_handle);
-          sl_app_assert(sc == SL_STATUS_OK,
-                     "[E: 0x%04x] Failed to synchronize to tag\n",
-                     (int)sc);
-
-          sprintf(str,"[E: 0x%04x] Failed to synchronize to tag\n",
-                  (int)sc);
-          sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
-          tag = get_connection_by_handle(sync_handle);
-          if (tag == NULL) {
-            add_connection(sync_handle, &evt->data.evt_scanner_scan_report.address, evt->data.evt_scanner_scan_report.address_type, 0);
-          }
-        }
-      }
+      handle_scan_report(&evt->data.evt_scanner_scan_report);
     } break;
 
     case sl_bt_evt_sync_opened_id:
     {
-      // Stop scanning
-      sc = sl_bt_scanner_stop();
-      sl_app_assert(sc == SL_STATUS_OK || sc == SL_STATUS_INVALID_STATE,
-                 "[E: 0x%04x] Failed to stop scanning\n",
-                 (int)sc);
+      conn_properties_t *tag;
+      sync_tag_t *sync_tag;
+
+      // The scheduler may have given up on the sync while it was being established, or the
+      // periodic train is on a PHY without CTE
+      sync_tag = sync_sched_opened(evt->data.evt_sync_opened.sync,
+                                   evt->data.evt_sync_opened.adv_interval,
+                                   evt->data.evt_sync_opened.adv_phy);
+      if (sync_tag == NULL) {
+        sl_bt_sync_close(evt->data.evt_sync_opened.sync);
+        break;
+      }
+      scan_policy_update();
+
+      TAG_TABLE_LOCK();
+      tag = add_connection(evt->data.evt_sync_opened.sync,
+                           &evt->data.evt_sync_opened.address,
+                           evt->data.evt_sync_opened.address_type,
+                           0);
+      TAG_TABLE_UNLOCK();
+      if (tag == NULL) {
+        sl_bt_sync_close(evt->data.evt_sync_opened.sync);
+        break;
+      }
+      // The tag's share of the processing budget follows its priority
+      sched_set_weight(tag, sync_tag->priority);
 
       // Start listening CTE on extended advertisements
-
-      sc = sl_bt_cte_receiver_enable_connectionless_cte(evt->data.evt_sync_opened.sync,
-                                                        CTE_SLOT_DURATION,
-                                                        CTE_COUNT,
-                                                        AOA_NUM_ARRAY_ELEMENTS,
-                                                        antenna_array);
+      sc = start_cte_receiver(tag);
 
       sl_app_assert(sc == SL_STATUS_OK,
                  "[E: 0x%04x] Failed to enable CTE\n",
                  (int)sc);
-      // Start scanning again for new devices
-      sc = sl_bt_scanner_start(gap_1m_phy, scanner_discover_generic);
-      sl_app_assert(sc == SL_STATUS_OK || sc == SL_STATUS_INVALID_STATE,
-                 "[E: 0x%04x] Failed to start scanning\n",
-                 (int)sc);
      } break;
 
     case sl_bt_evt_sync_closed_id:
     {
-      remove_connection(evt->data.evt_cte_receiver_connectionless_iq_report.sync);
-      // start scanning again to find new devices
-      sc = sl_bt_scanner_start(gap_1m_phy, scanner_discover_generic);
-      sl_app_assert(sc == SL_STATUS_OK || sc == SL_STATUS_INVALID_STATE,
-                 "[E: 0x%04x] Failed to start scanning\n",
-                 (int)sc);
+      TAG_TABLE_LOCK();
+      remove_connection(evt->data.evt_sync_closed.sync);
+      TAG_TABLE_UNLOCK();
+      // Rotated out, lost or never established, the sync goes to the next waiting tag or a lost
+      // tag is resynced directly. The scanner keeps running, only its duty cycle follows the syncs.
+      sync_sched_closed(evt->data.evt_sync_closed.sync);
+      scan_policy_update();
     } break;
 
     case sl_bt_evt_cte_receiver_connectionless_iq_report_id:
@@ -257,12 +445,35 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
       if (tag == NULL) {
         break;
       }
+      scan_policy_iq_received();
+      sync_sched_iq_received(evt->data.evt_cte_receiver_connectionless_iq_report.sync);
+
+      // CTE settings changed, re-applied on the running sync. This report was taken with the old
+      // settings and is dropped.
+      if (tag->cte_generation != aoa_cfg_get_cte_generation()) {
+        sl_bt_cte_receiver_disable_connectionless_cte(tag->connection_handle);
+        sc = start_cte_receiver(tag);
+        sl_app_assert(sc == SL_STATUS_OK,
+                      "[E: 0x%04x] Failed to enable CTE\n",
+                      (int)sc);
+        break;
+      }
 
+      // Samples beyond the tag's last snapshot are dropped here already
       uint32_t slen = evt->data.evt_cte_receiver_connectionless_iq_report.samples.len;
+      if (slen > aoa_tag_get_report_len(conn_aoa_state(tag))) {
+        slen = aoa_tag_get_report_len(conn_aoa_state(tag));
+      }
       int8_t rssi = evt->data.evt_cte_receiver_connectionless_iq_report.rssi;
       uint8_t channel = evt->data.evt_cte_receiver_connectionless_iq_report.channel;
 
-      app_iq_samples_ready(tag, evt->data.evt_cte_receiver_connectionless_iq_report.samples.data, slen, rssi, channel, tag->seq_num_dummy);
+#if defined(SL_CATALOG_KERNEL_PRESENT)
+      // Hand the report to the DSP task
+      app_rtos_post_iq_report(tag, evt->data.evt_cte_receiver_connectionless_iq_report.samples.data, slen, rssi, channel, tag->seq_num_dummy);
+#else
+      // Queue the report, it is processed from app_process_action() within the CPU budget
+      sched_submit(tag, evt->data.evt_cte_receiver_connectionless_iq_report.samples.data, slen, rssi, channel, tag->seq_num_dummy);
+#endif
 
       // Dummy counter running from 9 to 0 and wrapping
       if (tag->seq_num_dummy == 0) {
@@ -272,6 +483,13 @@ void sl_bt_on_event(sl_bt_msg_t *evt)
       }
     } break;
 
+    case sl_bt_evt_system_external_signal_id:
+    {
+      if (evt->data.evt_system_external_signal.extsignals & TIMER_WHEEL_SIGNAL) {
+        timer_wheel_process();
+      }
+    } break;
+
     ///////////////////////////////////////////////////////////////////////////
     // Add additional event handlers here as your application requires!      //
     ///////////////////////////////////////////////////////////////////////////
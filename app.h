@@ -20,29 +20,19 @@
 #include "aoa.h"
 #include "conn.h"
 
-#define NUM_ANTENNAS       16
 #define SERVICE_UUID_LEN 16
 #define CHAR_UUID_LEN 16
-#define AD_FIELD_I 0x06
-#define AD_FIELD_C 0x07
-#define SWITCHING_PATTERN  { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }
 
-#define SYNC_SKIP                     1    //one packet can be skipped
-#define SYNC_TIMEOUT                  100  //1000ms
-
-#define CTE_SLOT_DURATION             1    //1us
-#define CTE_COUNT                     1    //1 per advertisement interval
-
-#define SCAN_INTERVAL                 16   //10ms
-#define SCAN_WINDOW                   16   //10ms
 #define SCAN_PASSIVE                  0
 #define SCAN_ACTIVE                   1
 
-#define AOA_NUM_SNAPSHOTS       (4)
-#define AOA_NUM_ARRAY_ELEMENTS  (4 * 4)
-#define AOA_REF_PERIOD_SAMPLES  (7)
+#define SCAN_REPORT_INTERVAL_MS       5000 // Interval of the $SCAN statistics lines
+#define CMD_POLL_INTERVAL_MS          100  // Command input polling of the kernel build
 
-void app_iq_samples_ready(conn_properties_t *tag, uint8_t* iq_samples, uint8_t slen, int8_t rssi, uint8_t channel, uint16_t event_counter);
+void app_iq_samples_ready(bd_addr *tag_address, uint8_t* iq_samples, uint8_t slen, int8_t rssi, uint8_t channel, uint16_t event_counter);
+void app_pattern_ready(bd_addr *tag_address, aoa_tag_state_t *tag_state);
+void app_angle_ready(bd_addr *tag_address, aoa_angle_t *angle);
+sl_status_t app_calculate_angle(conn_properties_t *tag, iq_report_t *report, aoa_angle_t *angle);
 
 /**************************************************************************//**
  * Application Init.
@@ -0,0 +1,271 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Kernel based processing pipeline. IQ reports taken in by the Bluetooth event handler are
+ *         passed to a DSP task for angle estimation, and from there to an output task writing the
+ *         results to the UART, through fixed-size message queues.
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include "sl_component_catalog.h"
+
+#if defined(SL_CATALOG_KERNEL_PRESENT)
+
+#include <stdio.h>
+#include <string.h>
+#include "cmsis_os2.h"
+#include "sl_app_assert.h"
+#include "sl_sleeptimer.h"
+#include "sl_iostream.h"
+#include "aoa_cfg.h"
+#include "app.h"
+#include "app_rtos.h"
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  uint16_t sync;
+  bd_addr address;
+  iq_report_t report;
+} iq_msg_t;
+
+typedef struct {
+  bd_addr address;
+  uint32_t intake_tick;
+#if AOA_ESTIMATION_ON_DEVICE
+  aoa_angle_t angle;
+#else
+  iq_report_t report;
+#endif
+} output_msg_t;
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+static osMessageQueueId_t iq_queue;
+static osMessageQueueId_t output_queue;
+
+// Guards the tag table against changes by the Bluetooth task while the DSP task uses a tag
+static osMutexId_t tag_table_mutex;
+
+// Each counter has a single writer task
+static uint32_t iq_posted;
+static uint32_t iq_dropped;
+static uint32_t output_dropped;
+static uint32_t output_written;
+static uint32_t latency_count;
+static uint32_t latency_sum_ticks;
+static uint32_t latency_max_ticks;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static void dsp_task(void *argument);
+static void output_task(void *argument);
+static void report_statistics(void);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+void app_rtos_init(void)
+{
+  osThreadId_t thread;
+  const osMutexAttr_t mutex_attr = {
+    .name = "Tag table",
+    .attr_bits = osMutexPrioInherit,
+  };
+  const osThreadAttr_t dsp_attr = {
+    .name = "AoA DSP",
+    .stack_size = APP_RTOS_DSP_TASK_STACK_SIZE,
+    .priority = APP_RTOS_DSP_TASK_PRIORITY,
+  };
+  const osThreadAttr_t output_attr = {
+    .name = "AoA output",
+    .stack_size = APP_RTOS_OUTPUT_TASK_STACK_SIZE,
+    .priority = APP_RTOS_OUTPUT_TASK_PRIORITY,
+  };
+
+  tag_table_mutex = osMutexNew(&mutex_attr);
+  sl_app_assert(tag_table_mutex != NULL, "[E] Failed to create tag table mutex\n");
+
+  iq_queue = osMessageQueueNew(APP_RTOS_IQ_QUEUE_LEN, sizeof(iq_msg_t), NULL);
+  sl_app_assert(iq_queue != NULL, "[E] Failed to create IQ queue\n");
+
+  output_queue = osMessageQueueNew(APP_RTOS_OUTPUT_QUEUE_LEN, sizeof(output_msg_t), NULL);
+  sl_app_assert(output_queue != NULL, "[E] Failed to create output queue\n");
+
+  thread = osThreadNew(dsp_task, NULL, &dsp_attr);
+  sl_app_assert(thread != NULL, "[E] Failed to create DSP task\n");
+
+  thread = osThreadNew(output_task, NULL, &output_attr);
+  sl_app_assert(thread != NULL, "[E] Failed to create output task\n");
+}
+
+bool app_rtos_post_iq_report(conn_properties_t *tag, const uint8_t *samples, uint8_t len, int8_t rssi, uint8_t channel, uint16_t event_counter)
+{
+  iq_msg_t msg;
+
+  if (len > AOA_IQ_REPORT_MAX_LEN) {
+    len = AOA_IQ_REPORT_MAX_LEN;
+  }
+
+  msg.sync = tag->connection_handle;
+  msg.address = tag->address;
+  msg.report.len = len;
+  msg.report.rssi = rssi;
+  msg.report.channel = channel;
+  msg.report.event_counter = event_counter;
+  msg.report.cte_generation = tag->cte_generation;
+  msg.report.intake_tick = sl_sleeptimer_get_tick_count();
+  memcpy(msg.report.samples, samples, len);
+
+  // Never block the Bluetooth event handler, drop the report if the DSP task is behind
+  if (osMessageQueuePut(iq_queue, &msg, 0, 0) != osOK) {
+    iq_dropped++;
+    return false;
+  }
+  iq_posted++;
+  return true;
+}
+
+void app_rtos_tag_table_lock(void)
+{
+  osMutexAcquire(tag_table_mutex, osWaitForever);
+}
+
+void app_rtos_tag_table_unlock(void)
+{
+  osMutexRelease(tag_table_mutex);
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+static void dsp_task(void *argument)
+{
+  static iq_msg_t msg;
+  static output_msg_t out;
+#if AOA_ESTIMATION_ON_DEVICE
+  static aoa_tag_state_t snapshot;
+  static aoa_channel_group_t group;
+#endif
+
+  (void)argument;
+
+  while (1) {
+    if (osMessageQueueGet(iq_queue, &msg, NULL, osWaitForever) != osOK) {
+      continue;
+    }
+    // Queued before a change of the CTE settings, it does not match the new ones
+    if (msg.report.cte_generation != aoa_cfg_get_cte_generation()) {
+      continue;
+    }
+
+    out.address = msg.address;
+    out.intake_tick = msg.report.intake_tick;
+
+#if AOA_ESTIMATION_ON_DEVICE
+    conn_properties_t *tag;
+    sl_status_t sc = SL_STATUS_NOT_FOUND;
+
+    // The tag may have been removed since the report was queued. Only the report is added and
+    // a complete group copied under the lock, the Bluetooth task never waits for an estimate.
+    app_rtos_tag_table_lock();
+    tag = get_connection_by_handle(msg.sync);
+    if (tag != NULL) {
+      sc = aoa_add_report(conn_aoa_state(tag), msg.report.samples, msg.report.len, msg.report.channel, msg.report.rssi, msg.report.event_counter);
+      if (sc == SL_STATUS_OK) {
+        aoa_tag_snapshot(conn_aoa_state(tag), &snapshot, &group);
+      }
+    }
+    app_rtos_tag_table_unlock();
+
+    if (sc != SL_STATUS_OK) {
+      continue;
+    }
+    sc = aoa_calculate(&snapshot, &out.angle);
+
+    app_rtos_tag_table_lock();
+    tag = get_connection_by_handle(msg.sync);
+    if (tag != NULL) {
+      aoa_tag_update(conn_aoa_state(tag), &snapshot);
+    }
+    app_rtos_tag_table_unlock();
+
+    if (sc != SL_STATUS_OK) {
+      continue;
+    }
+#else
+    out.report = msg.report;
+#endif
+
+    // Results are dropped rather than stalling estimation when the UART is saturated
+    if (osMessageQueuePut(output_queue, &out, 0, 0) != osOK) {
+      output_dropped++;
+    }
+  }
+}
+
+static void output_task(void *argument)
+{
+  static output_msg_t msg;
+  uint32_t latency;
+  uint32_t last_report = sl_sleeptimer_get_tick_count();
+  uint32_t timeout = osKernelGetTickFreq() * APP_RTOS_POLL_INTERVAL_MS / 1000;
+
+  (void)argument;
+
+  while (1) {
+    if (osMessageQueueGet(output_queue, &msg, NULL, timeout) == osOK) {
+#if AOA_ESTIMATION_ON_DEVICE
+      app_angle_ready(&msg.address, &msg.angle);
+#else
+      app_iq_samples_ready(&msg.address, msg.report.samples, msg.report.len, msg.report.rssi, msg.report.channel, msg.report.event_counter);
+#endif
+      latency = sl_sleeptimer_get_tick_count() - msg.intake_tick;
+      latency_count++;
+      latency_sum_ticks += latency;
+      if (latency > latency_max_ticks) {
+        latency_max_ticks = latency;
+      }
+      output_written++;
+    }
+
+    if (sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count() - last_report) >= APP_RTOS_STATS_INTERVAL_MS) {
+      last_report = sl_sleeptimer_get_tick_count();
+      report_statistics();
+    }
+  }
+}
+
+static void report_statistics(void)
+{
+  char str[100];
+
+  // Counters are cumulative, latencies cover one reporting interval
+  // $RTOS,<reports queued>,<dropped at intake>,<dropped at output>,<written>,<avg latency ms>,<max latency ms>
+  sprintf(str, "$RTOS,%lu,%lu,%lu,%lu,%lu,%lu\n",
+          iq_posted,
+          iq_dropped,
+          output_dropped,
+          output_written,
+          (latency_count > 0) ? sl_sleeptimer_tick_to_ms(latency_sum_ticks / latency_count) : 0,
+          sl_sleeptimer_tick_to_ms(latency_max_ticks));
+  sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+
+  latency_count = 0;
+  latency_sum_ticks = 0;
+  latency_max_ticks = 0;
+}
+
+#endif // SL_CATALOG_KERNEL_PRESENT
@@ -0,0 +1,66 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Kernel based processing pipeline header file
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef APP_RTOS_H
+#define APP_RTOS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "conn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************************************//**
+ * @addtogroup Application
+ * @{
+ **************************************************************************************************/
+
+/***********************************************************************************************//**
+ * @addtogroup app
+ * @{
+ **************************************************************************************************/
+
+// Depth of the fixed-size message queues between the tasks
+#define APP_RTOS_IQ_QUEUE_LEN           4
+#define APP_RTOS_OUTPUT_QUEUE_LEN       4
+
+// Bluetooth events are taken in by the stack's event handler task, which runs above these
+#define APP_RTOS_DSP_TASK_PRIORITY      osPriorityNormal
+#define APP_RTOS_DSP_TASK_STACK_SIZE    2048
+#define APP_RTOS_OUTPUT_TASK_PRIORITY   osPriorityLow
+#define APP_RTOS_OUTPUT_TASK_STACK_SIZE 1024
+
+#define APP_RTOS_STATS_INTERVAL_MS      5000  // Interval of the $RTOS statistics lines
+#define APP_RTOS_POLL_INTERVAL_MS       100   // Longest wait of the output task between statistics checks
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void app_rtos_init(void);
+
+bool app_rtos_post_iq_report(conn_properties_t *tag, const uint8_t *samples, uint8_t len, int8_t rssi, uint8_t channel, uint16_t event_counter);
+
+void app_rtos_tag_table_lock(void);
+void app_rtos_tag_table_unlock(void);
+
+/** @} (end addtogroup app) */
+/** @} (end addtogroup Application) */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* APP_RTOS_H */
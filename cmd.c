@@ -0,0 +1,132 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  UART command handler, reads configuration commands from the host and dispatches them to
+ *         the module that registered the command
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "sl_iostream.h"
+#include "sl_iostream_init_usart_instances.h"
+#include "cmd.h"
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  const char *name;
+  cmd_handler_t handler;
+} cmd_entry_t;
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+static cmd_entry_t commands[CMD_MAX_COMMANDS];
+static uint8_t command_count;
+
+static char line[CMD_LINE_MAX_LEN];
+static uint8_t line_len;
+static bool line_overflow;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static void execute_line(void);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+void cmd_init(void)
+{
+  command_count = 0;
+  line_len = 0;
+  line_overflow = false;
+
+  // Polled from the main loop, reading must never block
+  sl_iostream_uart_set_read_block(sl_iostream_uart_exp_handle, false);
+}
+
+sl_status_t cmd_register(const char *name, cmd_handler_t handler)
+{
+  if (command_count >= CMD_MAX_COMMANDS) {
+    return SL_STATUS_FULL;
+  }
+  commands[command_count].name = name;
+  commands[command_count].handler = handler;
+  command_count++;
+  return SL_STATUS_OK;
+}
+
+void cmd_process(void)
+{
+  char c;
+  size_t bytes_read;
+
+  while (sl_iostream_read(SL_IOSTREAM_STDIN, &c, 1, &bytes_read) == SL_STATUS_OK && bytes_read == 1) {
+    if (c == '\r' || c == '\n') {
+      if (line_len > 0 && !line_overflow) {
+        line[line_len] = '\0';
+        execute_line();
+      }
+      line_len = 0;
+      line_overflow = false;
+    } else if (line_len < CMD_LINE_MAX_LEN - 1) {
+      line[line_len++] = c;
+    } else {
+      // Too long to be a valid command, ignore up to the end of the line
+      line_overflow = true;
+    }
+  }
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+static void execute_line(void)
+{
+  char str[32];
+  char *argv[CMD_MAX_ARGS];
+  uint8_t argc = 0;
+  char *token;
+  sl_status_t sc = SL_STATUS_NOT_FOUND;
+
+  if (line[0] != '$') {
+    return;
+  }
+
+  // Split the line at the commas, in place
+  token = &line[1];
+  while (token != NULL && argc < CMD_MAX_ARGS) {
+    argv[argc++] = token;
+    token = strchr(token, ',');
+    if (token != NULL) {
+      *token++ = '\0';
+    }
+  }
+
+  for (uint8_t i = 0; i < command_count; i++) {
+    if (strcmp(commands[i].name, argv[0]) == 0) {
+      sc = commands[i].handler(argc, argv);
+      break;
+    }
+  }
+
+  if (sc == SL_STATUS_OK) {
+    snprintf(str, sizeof(str), "$OK,%.16s\n", argv[0]);
+  } else {
+    snprintf(str, sizeof(str), "$ERR,%.16s,0x%04x\n", argv[0], (unsigned int)sc);
+  }
+  sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+}
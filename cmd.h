@@ -0,0 +1,63 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  UART command handler header file
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef CMD_H
+#define CMD_H
+
+#include <stdint.h>
+#include "sl_status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************************************//**
+ * @addtogroup Application
+ * @{
+ **************************************************************************************************/
+
+/***********************************************************************************************//**
+ * @addtogroup app
+ * @{
+ **************************************************************************************************/
+
+// Commands are ASCII lines in the same format as the output: $<NAME>,<arg>,...,<arg>\n
+#define CMD_LINE_MAX_LEN  128
+#define CMD_MAX_ARGS      20
+#define CMD_MAX_COMMANDS  16
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+// Handles one command, argv[0] is the command name. Answered with $OK or $ERR,<status>
+typedef sl_status_t (*cmd_handler_t)(uint8_t argc, char *argv[]);
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void cmd_init(void);
+
+sl_status_t cmd_register(const char *name, cmd_handler_t handler);
+
+void cmd_process(void);
+
+/** @} (end addtogroup app) */
+/** @} (end addtogroup Application) */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* CMD_H */
@@ -15,20 +15,56 @@
 #include "conn.h"
 #include "stdint.h"
 #include <stdio.h>
+#include <string.h>
 #include "aoa.h"
 #include "conn.h"
+#include "sched.h"
 
 /***************************************************************************************************
  * Static Variable Declarations
  **************************************************************************************************/
 
 
-// Array for holding properties of multiple (parallel) connections
+// Array for holding properties of multiple (parallel) connections. Entries stay in their slot
+// for their whole lifetime, free slots have an invalid connection handle.
 static conn_properties_t conn_properties[AOA_MAX_TAGS];
 
+/***************************************************************************************************
+ * Public Variable Definitions
+ **************************************************************************************************/
+
+aoa_tag_state_t conn_aoa_states[AOA_MAX_TAGS];
+iq_report_t conn_iq_reports[AOA_MAX_TAGS];
+sched_tag_state_t conn_sched_states[AOA_MAX_TAGS];
+#if AOA_ESTIMATION_ON_DEVICE
+aoa_channel_group_t conn_channel_groups[AOA_MAX_TAGS];
+#endif
+#if CONN_CONNECTION_ORIENTED
+conn_cold_t conn_cold_states[AOA_MAX_TAGS];
+#endif
+
+// Slot of each connection handle, TABLE_INDEX_INVALID if the handle is not in use
+static uint8_t handle_to_slot[CONN_HANDLE_MAP_SIZE];
+
+// Slots by address hash, linear probing, TABLE_INDEX_INVALID marks an empty bucket
+static uint8_t address_index[CONN_ADDRESS_INDEX_SIZE];
+
+// Free slots, linked through next_free_slot
+static uint8_t next_free_slot[AOA_MAX_TAGS];
+static uint8_t free_slot_head;
+
 // Counter of active connections
 static uint8_t active_connections_num;
 
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static uint8_t find_slot(uint16_t connection);
+static void clear_slot(uint8_t slot);
+static void address_index_insert(uint8_t slot);
+static void address_index_remove(uint8_t slot);
+
 /***************************************************************************************************
  * Public Function Definitions
  **************************************************************************************************/
@@ -37,32 +73,55 @@ void init_connection(void)
   uint8_t i;
   active_connections_num = 0;
 
-  // Initialize connection state variables
+  // Initialize connection state variables, all slots are free
   for (i = 0; i < AOA_MAX_TAGS; i++) {
-    conn_properties[i].connection_handle = CONNECTION_HANDLE_INVALID;
-    conn_properties[i].rssi = RSSI_INVALID;
-    conn_properties[i].cte_service_handle = SERVICE_HANDLE_INVALID;
-    conn_properties[i].cte_enable_char_handle = CHARACTERISTIC_HANDLE_INVALID;
+    conn_properties[i].slot = i;
+    clear_slot(i);
+    next_free_slot[i] = i + 1;
   }
+  next_free_slot[AOA_MAX_TAGS - 1] = TABLE_INDEX_INVALID;
+  free_slot_head = 0;
+
+  memset(handle_to_slot, TABLE_INDEX_INVALID, sizeof(handle_to_slot));
+  memset(address_index, TABLE_INDEX_INVALID, sizeof(address_index));
 }
 
 conn_properties_t* add_connection(uint16_t connection, bd_addr *address, uint8_t address_type, uint8_t connection_state)
 {
   conn_properties_t* ret = NULL;
+  uint8_t slot = free_slot_head;
 
   // If there is place to store new connection
-  if (active_connections_num < AOA_MAX_TAGS) {
+  if (slot != TABLE_INDEX_INVALID) {
+    free_slot_head = next_free_slot[slot];
+    if (connection < CONN_HANDLE_MAP_SIZE) {
+      handle_to_slot[connection] = slot;
+    }
+
     // Store the connection handle, and the server address
-    conn_properties[active_connections_num].connection_handle = connection;
-    conn_properties[active_connections_num].address = *address;
-    conn_properties[active_connections_num].address_type = address_type;
-    conn_properties[active_connections_num].connection_state = connection_state;
-    aoa_init(&conn_properties[active_connections_num].aoa_states);
+    ret = &conn_properties[slot];
+    ret->connection_handle = connection;
+    ret->address = *address;
+    ret->address_type = address_type;
+#if CONN_CONNECTION_ORIENTED
+    conn_cold(ret)->connection_state = connection_state;
+#else
+    (void)connection_state;
+#endif
+    address_index_insert(slot);
+#if AOA_ESTIMATION_ON_DEVICE
+    aoa_tag_init(conn_aoa_state(ret), conn_channel_group(ret));
+#else
+    aoa_tag_init(conn_aoa_state(ret), NULL);
+#endif
 
     // Dummy sequence number running from 9->0
-    conn_properties[active_connections_num].seq_num_dummy = 9;
+    ret->seq_num_dummy = 9;
+    // No report queued yet, scheduler bookkeeping starts from zero
+    memset(conn_iq_report(ret), 0, sizeof(iq_report_t));
+    memset(conn_sched(ret), 0, sizeof(sched_tag_state_t));
+    conn_sched(ret)->weight = SCHED_DEFAULT_WEIGHT;
     // Entry is now valid
-    ret = &conn_properties[active_connections_num];
     active_connections_num++;
   }
   return ret;
@@ -70,44 +129,32 @@ conn_properties_t* add_connection(uint16_t connection, bd_addr *address, uint8_t
 
 uint8_t remove_connection(uint16_t connection)
 {
-  uint8_t i;
-  uint8_t table_index = TABLE_INDEX_INVALID;
+  uint8_t slot;
 
   // If there are no open connections, return error
   if (active_connections_num == 0) {
     return 1;
   }
 
-  // Find the table index of the connection to be removed
-  for (uint8_t i = 0; i < active_connections_num; i++) {
-    if (conn_properties[i].connection_handle == connection) {
-      table_index = i;
-      break;
-    }
-  }
-
   // If connection not found, return error
-  if (table_index == TABLE_INDEX_INVALID) {
+  slot = find_slot(connection);
+  if (slot == TABLE_INDEX_INVALID) {
     return 1;
   }
 
-  aoa_deinit(&conn_properties[table_index].aoa_states);
+  aoa_tag_deinit(&conn_aoa_states[slot]);
+  address_index_remove(slot);
 
   // Decrease number of active connections
   active_connections_num--;
 
-  // Shift entries after the removed connection toward 0 index
-  for (i = table_index; i < active_connections_num; i++) {
-    conn_properties[i] = conn_properties[i + 1];
-  }
-
-  // Clear the slots we've just removed so no junk values appear
-  for (i = active_connections_num; i < AOA_MAX_TAGS; i++) {
-    conn_properties[i].connection_handle = CONNECTION_HANDLE_INVALID;
-    conn_properties[i].rssi = RSSI_INVALID;
-    conn_properties[i].cte_service_handle = SERVICE_HANDLE_INVALID;
-    conn_properties[i].cte_enable_char_handle = CHARACTERISTIC_HANDLE_INVALID;
+  // Other entries stay where they are, the slot goes back to the free list
+  if (connection < CONN_HANDLE_MAP_SIZE) {
+    handle_to_slot[connection] = TABLE_INDEX_INVALID;
   }
+  clear_slot(slot);
+  next_free_slot[slot] = free_slot_head;
+  free_slot_head = slot;
 
   return 0;
 }
@@ -120,40 +167,71 @@ uint8_t is_connection_list_full(void)
 
 conn_properties_t* get_connection_by_handle(uint16_t connection_handle)
 {
-  conn_properties_t* ret = NULL;
-  // Find the connection state entry in the table corresponding to the connection handle
-  for (uint8_t i = 0; i < active_connections_num; i++) {
-    if (conn_properties[i].connection_handle == connection_handle) {
-      // Return a pointer to the connection state entry
-      ret = &conn_properties[i];
-      break;
-    }
-  }
+  uint8_t slot = find_slot(connection_handle);
+
   // Return error if connection not found
-  return ret;
+  if (slot == TABLE_INDEX_INVALID) {
+    return NULL;
+  }
+  // Return a pointer to the connection state entry
+  return &conn_properties[slot];
 }
 
-conn_properties_t* get_connection_by_address(bd_addr* address)
+conn_properties_t* get_connection_by_address(const bd_addr* address, uint8_t address_type)
 {
-  conn_properties_t* ret = NULL;
-  // Find the connection state entry in the table corresponding to the connection address
-  for (uint8_t i = 0; i < active_connections_num; i++) {
-    if (0 == memcmp(address, &(conn_properties[i].address), sizeof(bd_addr))) {
+  uint32_t bucket = conn_address_hash(address, address_type) & (CONN_ADDRESS_INDEX_SIZE - 1);
+  uint8_t slot;
+
+  // Probe until the entry or an empty bucket is found, the index is never more than half full
+  while ((slot = address_index[bucket]) != TABLE_INDEX_INVALID) {
+    if (conn_properties[slot].address_type == address_type
+        && 0 == memcmp(address, &(conn_properties[slot].address), sizeof(bd_addr))) {
       // Return a pointer to the connection state entry
-      ret = &conn_properties[i];
-      break;
+      return &conn_properties[slot];
     }
+    bucket = (bucket + 1) & (CONN_ADDRESS_INDEX_SIZE - 1);
   }
   // Return error if connection not found
-  return ret;
+  return NULL;
+}
+
+conn_properties_t* get_connection_by_index(uint8_t index)
+{
+  // Free slots have no entry
+  if (index >= AOA_MAX_TAGS || conn_properties[index].connection_handle == CONNECTION_HANDLE_INVALID) {
+    return NULL;
+  }
+  return &conn_properties[index];
 }
 
+uint32_t conn_address_hash(const bd_addr *address, uint8_t address_type)
+{
+  // FNV-1a over the address and its type
+  uint32_t hash = 2166136261u;
+
+  for (uint8_t i = 0; i < sizeof(address->addr); i++) {
+    hash = (hash ^ address->addr[i]) * 16777619u;
+  }
+  hash = (hash ^ address_type) * 16777619u;
+
+  return hash ^ (hash >> 16);
+}
+
+uint8_t get_connection_count(void)
+{
+  return active_connections_num;
+}
+
+#if CONN_CONNECTION_ORIENTED
 void set_connections_parameters(unsigned int interval)
 {
   uint8_t i;
 
   // Set connection interval for all active connections
-  for (i = 0; i < active_connections_num; i++) {
+  for (i = 0; i < AOA_MAX_TAGS; i++) {
+    if (conn_properties[i].connection_handle == CONNECTION_HANDLE_INVALID) {
+      continue;
+    }
     sl_bt_connection_set_parameters(conn_properties[i].connection_handle,
                                     interval,
                                     interval,
@@ -163,3 +241,77 @@ void set_connections_parameters(unsigned int interval)
                                     0xFFFF);
   }
 }
+#endif
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+static uint8_t find_slot(uint16_t connection)
+{
+  if (connection < CONN_HANDLE_MAP_SIZE) {
+    return handle_to_slot[connection];
+  }
+
+  // Handles outside the map are not expected from the stack, but still found
+  for (uint8_t i = 0; i < AOA_MAX_TAGS; i++) {
+    if (conn_properties[i].connection_handle == connection) {
+      return i;
+    }
+  }
+  return TABLE_INDEX_INVALID;
+}
+
+static void clear_slot(uint8_t slot)
+{
+  conn_properties[slot].connection_handle = CONNECTION_HANDLE_INVALID;
+#if CONN_CONNECTION_ORIENTED
+  conn_cold_states[slot].rssi = RSSI_INVALID;
+  conn_cold_states[slot].cte_service_handle = SERVICE_HANDLE_INVALID;
+  conn_cold_states[slot].cte_enable_char_handle = CHARACTERISTIC_HANDLE_INVALID;
+#endif
+}
+
+static void address_index_insert(uint8_t slot)
+{
+  uint32_t bucket = conn_address_hash(&conn_properties[slot].address, conn_properties[slot].address_type)
+                    & (CONN_ADDRESS_INDEX_SIZE - 1);
+
+  while (address_index[bucket] != TABLE_INDEX_INVALID) {
+    bucket = (bucket + 1) & (CONN_ADDRESS_INDEX_SIZE - 1);
+  }
+  address_index[bucket] = slot;
+}
+
+static void address_index_remove(uint8_t slot)
+{
+  uint32_t bucket = conn_address_hash(&conn_properties[slot].address, conn_properties[slot].address_type)
+                    & (CONN_ADDRESS_INDEX_SIZE - 1);
+  uint32_t next;
+  uint32_t home;
+
+  while (address_index[bucket] != slot) {
+    if (address_index[bucket] == TABLE_INDEX_INVALID) {
+      return;
+    }
+    bucket = (bucket + 1) & (CONN_ADDRESS_INDEX_SIZE - 1);
+  }
+
+  // Move later entries of the probe run back into the gap, so lookups need no tombstones
+  next = bucket;
+  while (1) {
+    next = (next + 1) & (CONN_ADDRESS_INDEX_SIZE - 1);
+    if (address_index[next] == TABLE_INDEX_INVALID) {
+      break;
+    }
+    home = conn_address_hash(&conn_properties[address_index[next]].address,
+                             conn_properties[address_index[next]].address_type)
+           & (CONN_ADDRESS_INDEX_SIZE - 1);
+    // The entry may move only if its home bucket is not between the gap and its position
+    if (((next - home) & (CONN_ADDRESS_INDEX_SIZE - 1)) >= ((next - bucket) & (CONN_ADDRESS_INDEX_SIZE - 1))) {
+      address_index[bucket] = address_index[next];
+      bucket = next;
+    }
+  }
+  address_index[bucket] = TABLE_INDEX_INVALID;
+}
@@ -16,6 +16,7 @@
 
 #include "sl_bt_api.h"
 #include "stdint.h"
+#include <stdbool.h>
 #include "aoa.h"
 
 #ifdef __cplusplus
@@ -43,22 +44,77 @@ extern "C" {
 #define CHARACTERISTIC_HANDLE_INVALID (uint16_t)0xFFFFu
 #define TABLE_INDEX_INVALID           (uint8_t)0xFFu
 
+// Connection and sync handles below this are looked up directly, the stack allocates them from 0
+#define CONN_HANDLE_MAP_SIZE          32
+
+// Open addressing index of the tag addresses, a power of two at least twice AOA_MAX_TAGS
+#define CONN_ADDRESS_INDEX_SIZE       32
+
+// Keep the connection oriented state of the tags, not needed for connectionless CTEs
+#ifndef CONN_CONNECTION_ORIENTED
+#define CONN_CONNECTION_ORIENTED      0
+#endif
+
 /***************************************************************************************************
  * Type Definitions
  **************************************************************************************************/
 
+// IQ report waiting to be processed, a newer report of the same tag overwrites it
 typedef struct {
-  uint16_t connection_handle;   //This is used for connection handle for connection oriented, and for sync handle for connection less mode
+  bool pending;
+  uint8_t len;
   int8_t rssi;
+  uint8_t channel;
+  uint16_t event_counter;
+  uint8_t cte_generation;  // CTE settings the samples were taken with
+  uint32_t intake_tick;  // Sleeptimer tick of the report event, for latency measurement
+  uint8_t samples[AOA_IQ_REPORT_MAX_LEN];
+} iq_report_t;
+
+// Per tag bookkeeping of the processing scheduler
+typedef struct {
+  uint8_t weight;       // Share of the CPU budget relative to the other tags
+  int32_t credit;       // Cycles the tag may still spend in the current period
+  uint32_t avg_cycles;  // Moving average of the cycles spent on one report
+  uint32_t served;      // Reports processed
+  uint32_t skipped;     // Reports overwritten by a newer one before being processed
+  uint32_t max_latency_ticks; // Longest time from report event to end of processing
+} sched_tag_state_t;
+
+// Connection oriented state, in a side table of its own
+typedef struct {
+  int8_t rssi;
+  uint8_t connection_state;
+  uint16_t cte_enable_char_handle;
+  uint32_t cte_service_handle;
+} conn_cold_t;
+
+// Entry of the tag table, only what the lookups and every report touch. The bulk of the per tag
+// state is kept in side tables indexed by the slot, see the accessors below.
+typedef struct {
+  uint16_t connection_handle;   //This is used for connection handle for connection oriented, and for sync handle for connection less mode
   bd_addr address;
   uint8_t address_type;
-  uint32_t cte_service_handle;
-  uint16_t cte_enable_char_handle;
-  uint8_t connection_state;
-  aoa_libitems_t aoa_states;
+  uint8_t slot;
   uint8_t seq_num_dummy;
+  uint8_t cte_generation;       // CTE settings the CTE receiver was enabled with
 } conn_properties_t;
 
+/***************************************************************************************************
+ * Public variables
+ **************************************************************************************************/
+
+// Side tables of the tag table, accessed through the conn_*() accessors
+extern aoa_tag_state_t conn_aoa_states[AOA_MAX_TAGS];
+extern iq_report_t conn_iq_reports[AOA_MAX_TAGS];
+extern sched_tag_state_t conn_sched_states[AOA_MAX_TAGS];
+#if AOA_ESTIMATION_ON_DEVICE
+extern aoa_channel_group_t conn_channel_groups[AOA_MAX_TAGS];
+#endif
+#if CONN_CONNECTION_ORIENTED
+extern conn_cold_t conn_cold_states[AOA_MAX_TAGS];
+#endif
+
 /***************************************************************************************************
  * Function Declarations
  **************************************************************************************************/
@@ -72,9 +128,59 @@ uint8_t remove_connection(uint16_t connection);
 uint8_t is_connection_list_full(void);
 
 conn_properties_t* get_connection_by_handle(uint16_t connection_handle);
-conn_properties_t* get_connection_by_address(bd_addr* address);
+conn_properties_t* get_connection_by_address(const bd_addr* address, uint8_t address_type);
+// Entry in table slot index (0 ... AOA_MAX_TAGS - 1), NULL if the slot is free
+conn_properties_t* get_connection_by_index(uint8_t index);
+uint8_t get_connection_count(void);
+
+// Hash of an address and its type for open addressing indexes, mask to the index size
+uint32_t conn_address_hash(const bd_addr *address, uint8_t address_type);
+
+// Convert a Bluetooth address to its decimal representation used in the output
+static inline uint64_t conn_address_to_id(const bd_addr *address)
+{
+  return ((uint64_t)address->addr[0]) | ((uint64_t)address->addr[1] << 8) | ((uint64_t)address->addr[2] << 16)
+         | ((uint64_t)address->addr[3] << 24) | ((uint64_t)address->addr[4] << 32) | ((uint64_t)address->addr[5] << 40);
+}
+
+// Inverse of conn_address_to_id(), for tag ids given in commands
+static inline void conn_id_to_address(uint64_t id, bd_addr *address)
+{
+  for (uint8_t i = 0; i < sizeof(address->addr); i++) {
+    address->addr[i] = (uint8_t)(id >> (8 * i));
+  }
+}
+
+static inline aoa_tag_state_t* conn_aoa_state(const conn_properties_t *tag)
+{
+  return &conn_aoa_states[tag->slot];
+}
+
+static inline iq_report_t* conn_iq_report(const conn_properties_t *tag)
+{
+  return &conn_iq_reports[tag->slot];
+}
+
+static inline sched_tag_state_t* conn_sched(const conn_properties_t *tag)
+{
+  return &conn_sched_states[tag->slot];
+}
+
+#if AOA_ESTIMATION_ON_DEVICE
+static inline aoa_channel_group_t* conn_channel_group(const conn_properties_t *tag)
+{
+  return &conn_channel_groups[tag->slot];
+}
+#endif
+
+#if CONN_CONNECTION_ORIENTED
+static inline conn_cold_t* conn_cold(const conn_properties_t *tag)
+{
+  return &conn_cold_states[tag->slot];
+}
 
 void set_connections_parameters(unsigned int value);
+#endif
 
 /** @} (end addtogroup app) */
 /** @} (end addtogroup Application) */
@@ -0,0 +1,348 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Adaptive scanner duty cycle. The scanner only runs continuously while syncs are being
+ *         established or were just lost, otherwise it leaves the radio to the periodic advertising
+ *         trains and their CTEs.
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "sl_app_assert.h"
+#include "sl_bt_api.h"
+#include "sl_sleeptimer.h"
+#include "sl_iostream.h"
+#include "nvm3_default.h"
+#include "aoa_cfg.h"
+#include "timer_wheel.h"
+#include "sync_sched.h"
+#include "cmd.h"
+#include "scan_policy.h"
+
+typedef struct {
+  uint16_t interval;
+  uint16_t window;
+} scan_timing_t;
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+static const scan_timing_t timings[SCAN_POLICY_LEVEL_COUNT] = {
+  { SCAN_POLICY_FULL_INTERVAL, SCAN_POLICY_FULL_WINDOW },
+  { SCAN_POLICY_DISCOVERY_INTERVAL, SCAN_POLICY_DISCOVERY_WINDOW },
+  { SCAN_POLICY_IDLE_INTERVAL, SCAN_POLICY_IDLE_WINDOW }
+};
+
+static const char *level_names[SCAN_POLICY_LEVEL_COUNT + 1] = { "FULL", "DISCOVERY", "IDLE", "AUTO" };
+
+static const uint8_t phy_masks[SCAN_POLICY_PHY_COUNT] = {
+  gap_1m_phy,
+  gap_coded_phy,
+  gap_1m_phy | gap_coded_phy
+};
+
+static const char *phy_names[SCAN_POLICY_PHY_COUNT] = { "1M", "CODED", "MIXED" };
+
+// Level the scanner runs at, SCAN_POLICY_LEVEL_COUNT while it is not started
+static uint8_t level = SCAN_POLICY_LEVEL_COUNT;
+// SCAN_POLICY_AUTO, or the level set with $SCANMODE
+static uint8_t mode = SCAN_POLICY_AUTO;
+// scan_policy_phy_t, stored in NVM3
+static uint8_t phy;
+// Scan interval of the level, before being shared between the PHYs
+static uint16_t interval;
+
+// Running while the scanner is boosted after a failed resync, and while tags are still appearing
+static timer_wheel_timer_t boost_timer;
+static timer_wheel_timer_t quiet_timer;
+static timer_wheel_timer_t report_timer;
+
+// Time spent and IQ reports received at each level since the last report
+static uint32_t level_tick;
+static uint32_t level_ms[SCAN_POLICY_LEVEL_COUNT];
+static uint32_t iq_reports[SCAN_POLICY_LEVEL_COUNT];
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static uint8_t select_level(void);
+static uint16_t level_interval(uint8_t new_level);
+static void apply(uint8_t new_level);
+static void start_scanner(uint8_t new_level);
+static void account(void);
+static void expiry_timer_cb(timer_wheel_timer_t *timer, void *data);
+static void report_timer_cb(timer_wheel_timer_t *timer, void *data);
+static sl_status_t mode_cmd(uint8_t argc, char *argv[]);
+static sl_status_t phy_cmd(uint8_t argc, char *argv[]);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+void scan_policy_init(void)
+{
+  level = SCAN_POLICY_LEVEL_COUNT;
+  mode = SCAN_POLICY_AUTO;
+  memset(level_ms, 0, sizeof(level_ms));
+  memset(iq_reports, 0, sizeof(iq_reports));
+
+  if (nvm3_readData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_SCAN_PHY, &phy, sizeof(phy)) != ECODE_NVM3_OK
+      || phy >= SCAN_POLICY_PHY_COUNT) {
+    phy = SCAN_POLICY_DEFAULT_PHY;
+  }
+
+  cmd_register("SCANMODE", mode_cmd);
+  cmd_register("SCANPHY", phy_cmd);
+
+  timer_wheel_start(&report_timer,
+                    SCAN_POLICY_REPORT_INTERVAL_MS,
+                    SCAN_POLICY_REPORT_INTERVAL_MS,
+                    report_timer_cb,
+                    NULL);
+}
+
+void scan_policy_start(void)
+{
+  // Tags are looked for at full duty first, as after a sync loss
+  level_tick = sl_sleeptimer_get_tick_count();
+  timer_wheel_start(&boost_timer, SCAN_POLICY_BOOST_MS, 0, expiry_timer_cb, NULL);
+  timer_wheel_start(&quiet_timer, SCAN_POLICY_QUIET_MS, 0, expiry_timer_cb, NULL);
+  apply(select_level());
+}
+
+void scan_policy_update(void)
+{
+  if (level < SCAN_POLICY_LEVEL_COUNT) {
+    apply(select_level());
+  }
+}
+
+void scan_policy_tag_found(void)
+{
+  timer_wheel_start(&quiet_timer, SCAN_POLICY_QUIET_MS, 0, expiry_timer_cb, NULL);
+  scan_policy_update();
+}
+
+void scan_policy_resync_failed(void)
+{
+  // The tag may have moved, or changed its advertising set, find it again by scanning
+  timer_wheel_start(&boost_timer, SCAN_POLICY_BOOST_MS, 0, expiry_timer_cb, NULL);
+  scan_policy_update();
+}
+
+void scan_policy_restart(void)
+{
+  if (level < SCAN_POLICY_LEVEL_COUNT) {
+    start_scanner(level);
+  }
+}
+
+void scan_policy_iq_received(void)
+{
+  if (level < SCAN_POLICY_LEVEL_COUNT) {
+    iq_reports[level]++;
+  }
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+static uint8_t select_level(void)
+{
+  uint8_t opening;
+  uint8_t in_use;
+
+  if (mode != SCAN_POLICY_AUTO) {
+    return mode;
+  }
+
+  // Syncs are established from the scan reports carrying the sync info
+  sync_sched_get_syncs(&opening, &in_use);
+  if (opening > 0 || timer_wheel_is_running(&boost_timer)) {
+    return SCAN_POLICY_FULL;
+  }
+  if (in_use < SYNC_SCHED_MAX_SYNCS && timer_wheel_is_running(&quiet_timer)) {
+    return SCAN_POLICY_DISCOVERY;
+  }
+  return SCAN_POLICY_IDLE;
+}
+
+// The IDLE duty is kept high enough to catch one of the advertisements of the slowest waiting
+// tag within SYNC_SCHED_SEEN_TIMEOUT_MS. Each advertisement is caught at a chance of the duty.
+// The periodic advertising interval stands in for the tag's unknown extended advertising one.
+static uint16_t level_interval(uint8_t new_level)
+{
+  uint16_t adv_interval;
+  float events;
+  float duty;
+
+  if (new_level != SCAN_POLICY_IDLE) {
+    return timings[new_level].interval;
+  }
+  adv_interval = sync_sched_get_waiting_interval();
+  if (adv_interval == 0) {
+    return SCAN_POLICY_IDLE_INTERVAL;
+  }
+
+  events = SYNC_SCHED_SEEN_TIMEOUT_MS / (adv_interval * 1.25f);
+  if (events < 1.0f) {
+    events = 1.0f;
+  }
+  duty = 1.0f - powf(SCAN_POLICY_IDLE_MISS, 1.0f / events);
+  if (SCAN_POLICY_IDLE_WINDOW >= duty * SCAN_POLICY_IDLE_INTERVAL) {
+    return SCAN_POLICY_IDLE_INTERVAL;
+  }
+  return (uint16_t)(SCAN_POLICY_IDLE_WINDOW / duty);
+}
+
+static void apply(uint8_t new_level)
+{
+  uint16_t new_interval = level_interval(new_level);
+
+  if (new_level == level && new_interval == interval) {
+    return;
+  }
+  account();
+  interval = new_interval;
+  start_scanner(new_level);
+  level = new_level;
+}
+
+static void start_scanner(uint8_t new_level)
+{
+  uint16_t phy_interval = interval;
+  sl_status_t sc;
+
+  // Each PHY gets every other interval when both are scanned. Halved, so that tags on either are
+  // still seen at the rate of the level.
+  if (phy == SCAN_POLICY_PHY_MIXED) {
+    phy_interval /= 2;
+    if (phy_interval < timings[new_level].window) {
+      phy_interval = timings[new_level].window;
+    }
+  }
+
+  // The timing and PHYs only take effect when the scanner is started again
+  sc = sl_bt_scanner_stop();
+  sl_app_assert(sc == SL_STATUS_OK || sc == SL_STATUS_INVALID_STATE,
+                "[E: 0x%04x] Failed to stop scanning\n",
+                (int)sc);
+  sc = sl_bt_scanner_set_timing(phy_masks[phy], phy_interval, timings[new_level].window);
+  sl_app_assert(sc == SL_STATUS_OK,
+                "[E: 0x%04x] Failed to set scanner timing\n",
+                (int)sc);
+  sc = sl_bt_scanner_start(phy_masks[phy], scanner_discover_observation);
+  sl_app_assert(sc == SL_STATUS_OK,
+                "[E: 0x%04x] Failed to start scanner\n",
+                (int)sc);
+}
+
+// Charge the time since the last level change or report to the current level
+static void account(void)
+{
+  uint32_t now = sl_sleeptimer_get_tick_count();
+
+  if (level < SCAN_POLICY_LEVEL_COUNT) {
+    level_ms[level] += sl_sleeptimer_tick_to_ms(now - level_tick);
+  }
+  level_tick = now;
+}
+
+static void expiry_timer_cb(timer_wheel_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+
+  scan_policy_update();
+}
+
+static void report_timer_cb(timer_wheel_timer_t *timer, void *data)
+{
+  char str[96];
+
+  (void)timer;
+  (void)data;
+
+  if (level >= SCAN_POLICY_LEVEL_COUNT) {
+    return;
+  }
+  account();
+
+  // IQ reports per second at each level give the CTE reception rate of the scan policy
+  // $SCANPOLICY,<level>,<ms full>,<ms discovery>,<ms idle>,<iq full>,<iq discovery>,<iq idle>,<phy>
+  sprintf(str, "$SCANPOLICY,%s,%lu,%lu,%lu,%lu,%lu,%lu,%s\n",
+          level_names[level],
+          level_ms[SCAN_POLICY_FULL],
+          level_ms[SCAN_POLICY_DISCOVERY],
+          level_ms[SCAN_POLICY_IDLE],
+          iq_reports[SCAN_POLICY_FULL],
+          iq_reports[SCAN_POLICY_DISCOVERY],
+          iq_reports[SCAN_POLICY_IDLE],
+          phy_names[phy]);
+  sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+
+  memset(level_ms, 0, sizeof(level_ms));
+  memset(iq_reports, 0, sizeof(iq_reports));
+}
+
+// $SCANMODE                                     current mode
+// $SCANMODE,<AUTO|FULL|DISCOVERY|IDLE>          fix the level to compare the policies, not stored
+static sl_status_t mode_cmd(uint8_t argc, char *argv[])
+{
+  char str[24];
+
+  if (argc == 1) {
+    sprintf(str, "$SCANMODE,%s\n", level_names[mode]);
+    sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    return SL_STATUS_OK;
+  }
+
+  if (argc != 2) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  for (uint8_t i = 0; i <= SCAN_POLICY_AUTO; i++) {
+    if (strcmp(argv[1], level_names[i]) == 0) {
+      mode = i;
+      scan_policy_update();
+      return SL_STATUS_OK;
+    }
+  }
+  return SL_STATUS_INVALID_PARAMETER;
+}
+
+// $SCANPHY                          current primary PHYs
+// $SCANPHY,<1M|CODED|MIXED>         scan on 1M, on Coded, or alternate between both, stored
+static sl_status_t phy_cmd(uint8_t argc, char *argv[])
+{
+  char str[24];
+
+  if (argc == 1) {
+    sprintf(str, "$SCANPHY,%s\n", phy_names[phy]);
+    sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    return SL_STATUS_OK;
+  }
+
+  if (argc != 2) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  for (uint8_t i = 0; i < SCAN_POLICY_PHY_COUNT; i++) {
+    if (strcmp(argv[1], phy_names[i]) == 0) {
+      phy = i;
+      scan_policy_restart();
+      if (nvm3_writeData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_SCAN_PHY, &phy, sizeof(phy)) != ECODE_NVM3_OK) {
+        return SL_STATUS_FAIL;
+      }
+      return SL_STATUS_OK;
+    }
+  }
+  return SL_STATUS_INVALID_PARAMETER;
+}
@@ -0,0 +1,104 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Adaptive scanner duty cycle header file
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef SCAN_POLICY_H
+#define SCAN_POLICY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************************************//**
+ * @addtogroup Application
+ * @{
+ **************************************************************************************************/
+
+/***********************************************************************************************//**
+ * @addtogroup app
+ * @{
+ **************************************************************************************************/
+
+// Scan interval and window of each level, in 0.625 ms
+#define SCAN_POLICY_FULL_INTERVAL       16    // 10 ms, 100 %
+#define SCAN_POLICY_FULL_WINDOW         16
+#define SCAN_POLICY_DISCOVERY_INTERVAL  32    // 20 ms, 50 %
+#define SCAN_POLICY_DISCOVERY_WINDOW    16
+#define SCAN_POLICY_IDLE_INTERVAL       160   // 100 ms, 10 %, longest, shortened for slow tags
+#define SCAN_POLICY_IDLE_WINDOW         16
+
+// Chance of a tag waiting for a sync going unseen for SYNC_SCHED_SEEN_TIMEOUT_MS at IDLE. Synced
+// tags are kept alive by their CTE reports, the others only by the scanner.
+#define SCAN_POLICY_IDLE_MISS           0.001f
+
+#define SCAN_POLICY_BOOST_MS            5000  // Full duty after boot and after a failed resync
+#define SCAN_POLICY_QUIET_MS            30000 // No new tags for this long, discovery is wound down
+#define SCAN_POLICY_REPORT_INTERVAL_MS  5000  // Interval of the $SCANPOLICY statistics lines
+
+#define SCAN_POLICY_DEFAULT_PHY         SCAN_POLICY_PHY_1M
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef enum {
+  SCAN_POLICY_FULL = 0,     // Syncs being established or just lost, they need the scanner
+  SCAN_POLICY_DISCOVERY,    // Free syncs and tags still appearing
+  SCAN_POLICY_IDLE,         // All syncs in use or no new tags, only keeps the known tags alive
+  SCAN_POLICY_LEVEL_COUNT,
+  SCAN_POLICY_AUTO = SCAN_POLICY_LEVEL_COUNT
+} scan_policy_level_t;
+
+// Primary advertising PHYs scanned. The primary channels only carry 1M and Coded, tags with their
+// extended or periodic advertisements on 2M are found on either. The controller follows the
+// periodic train on the PHY given in its sync info.
+typedef enum {
+  SCAN_POLICY_PHY_1M = 0,
+  SCAN_POLICY_PHY_CODED,          // Long range, about four times the airtime per advertisement
+  SCAN_POLICY_PHY_MIXED,          // Alternated every scan interval, at twice the duty of one PHY
+  SCAN_POLICY_PHY_COUNT
+} scan_policy_phy_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void scan_policy_init(void);
+
+// Start the scanner, after the boot event
+void scan_policy_start(void);
+
+// Reevaluate the level, on every change of the syncs
+void scan_policy_update(void);
+
+void scan_policy_tag_found(void);
+
+// A lost tag could not be resynced directly, look for it at full duty
+void scan_policy_resync_failed(void);
+
+// Start the scanner again at the current level, for settings only read at its start
+void scan_policy_restart(void);
+
+// Counted per level, for the reception rate of each
+void scan_policy_iq_received(void);
+
+/** @} (end addtogroup app) */
+/** @} (end addtogroup Application) */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* SCAN_POLICY_H */
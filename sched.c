@@ -0,0 +1,267 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Scheduler of the per tag report processing. Every tag gets a weighted share of a CPU
+ *         cycle budget per period, tags over their share have their reports coalesced.
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <malloc.h>
+#include "em_device.h"
+#include "sl_sleeptimer.h"
+#include "sl_iostream.h"
+#include "aoa_cfg.h"
+#include "sched.h"
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+static sched_process_cb_t process_callback;
+
+static sl_sleeptimer_timer_handle_t period_timer;
+static volatile bool period_elapsed;
+
+// CPU cycles available for report processing in one period
+static uint32_t period_budget;
+static int32_t budget_left;
+
+// Round robin position, the tag after the last served one is looked at first
+static uint8_t next_index;
+
+static uint32_t period_count;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static void period_timer_cb(sl_sleeptimer_timer_handle_t *handle, void *data);
+static void start_period(void);
+static void report_statistics(void);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+void sched_init(sched_process_cb_t process_cb)
+{
+  process_callback = process_cb;
+
+  // Enable the DWT cycle counter used to measure the processing cost
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  period_budget = (uint32_t)((uint64_t)SystemCoreClockGet() * SCHED_PERIOD_MS / 1000 * SCHED_CPU_BUDGET_PERCENT / 100);
+  period_count = 0;
+  next_index = 0;
+
+  // Hand out the first credits on the next step
+  period_elapsed = true;
+  sl_sleeptimer_start_periodic_timer_ms(&period_timer, SCHED_PERIOD_MS, period_timer_cb, NULL, 0, 0);
+}
+
+void sched_submit(conn_properties_t *tag, const uint8_t *samples, uint8_t len, int8_t rssi, uint8_t channel, uint16_t event_counter)
+{
+  iq_report_t *report = conn_iq_report(tag);
+
+  // The previous report was not served in time, the newer one replaces it
+  if (report->pending) {
+    conn_sched(tag)->skipped++;
+  }
+
+  if (len > AOA_IQ_REPORT_MAX_LEN) {
+    len = AOA_IQ_REPORT_MAX_LEN;
+  }
+  memcpy(report->samples, samples, len);
+  report->len = len;
+  report->rssi = rssi;
+  report->channel = channel;
+  report->event_counter = event_counter;
+  report->cte_generation = tag->cte_generation;
+  report->intake_tick = sl_sleeptimer_get_tick_count();
+  report->pending = true;
+}
+
+bool sched_step(void)
+{
+  uint8_t index;
+  uint32_t start;
+  uint32_t cycles;
+  uint32_t latency;
+  conn_properties_t *tag;
+  sched_tag_state_t *state;
+
+  if (period_elapsed) {
+    period_elapsed = false;
+    start_period();
+  }
+
+  if (budget_left <= 0) {
+    return false;
+  }
+
+  // Walk the table slots, starting after the tag served last
+  for (uint8_t i = 0; i < AOA_MAX_TAGS; i++) {
+    index = (next_index + i) % AOA_MAX_TAGS;
+    tag = get_connection_by_index(index);
+    if (tag == NULL) {
+      continue;
+    }
+    state = conn_sched(tag);
+    if (state->credit <= 0 || !conn_iq_report(tag)->pending) {
+      continue;
+    }
+    // Queued before a change of the CTE settings, it does not match the new ones
+    if (conn_iq_report(tag)->cte_generation != aoa_cfg_get_cte_generation()) {
+      conn_iq_report(tag)->pending = false;
+      continue;
+    }
+
+    // Serve only one report per call to keep the Bluetooth stack responsive
+    start = DWT->CYCCNT;
+    process_callback(tag);
+    cycles = DWT->CYCCNT - start;
+
+    conn_iq_report(tag)->pending = false;
+    state->served++;
+    latency = sl_sleeptimer_get_tick_count() - conn_iq_report(tag)->intake_tick;
+    if (latency > state->max_latency_ticks) {
+      state->max_latency_ticks = latency;
+    }
+    state->credit -= (int32_t)cycles;
+    budget_left -= (int32_t)cycles;
+
+    if (state->avg_cycles == 0) {
+      state->avg_cycles = cycles;
+    } else {
+      state->avg_cycles = state->avg_cycles - state->avg_cycles / 8 + cycles / 8;
+    }
+
+    next_index = (index + 1) % AOA_MAX_TAGS;
+    return true;
+  }
+
+  return false;
+}
+
+bool sched_is_work_ready(void)
+{
+  conn_properties_t *tag;
+
+  if (period_elapsed) {
+    return true;
+  }
+
+  if (budget_left <= 0) {
+    return false;
+  }
+
+  for (uint8_t i = 0; i < AOA_MAX_TAGS; i++) {
+    tag = get_connection_by_index(i);
+    if (tag != NULL && conn_sched(tag)->credit > 0 && conn_iq_report(tag)->pending) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void sched_set_weight(conn_properties_t *tag, uint8_t weight)
+{
+  // A zero weight would starve the tag
+  conn_sched(tag)->weight = (weight == 0) ? 1 : weight;
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+static void period_timer_cb(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)handle;
+  (void)data;
+  period_elapsed = true;
+}
+
+static void start_period(void)
+{
+  uint32_t total_weight = 0;
+  int32_t share;
+  conn_properties_t *tag;
+  sched_tag_state_t *state;
+
+  budget_left = (int32_t)period_budget;
+
+  for (uint8_t i = 0; i < AOA_MAX_TAGS; i++) {
+    tag = get_connection_by_index(i);
+    if (tag != NULL) {
+      total_weight += conn_sched(tag)->weight;
+    }
+  }
+
+  // Weighted share of the budget, tags in debt from an expensive report recover over time
+  for (uint8_t i = 0; i < AOA_MAX_TAGS && total_weight > 0; i++) {
+    tag = get_connection_by_index(i);
+    if (tag == NULL) {
+      continue;
+    }
+    state = conn_sched(tag);
+    share = (int32_t)((uint64_t)period_budget * state->weight / total_weight);
+    state->credit += share;
+    if (state->credit > share * SCHED_MAX_CREDIT_PERIODS) {
+      state->credit = share * SCHED_MAX_CREDIT_PERIODS;
+    }
+  }
+
+  period_count++;
+  if (period_count >= SCHED_REPORT_INTERVAL_MS / SCHED_PERIOD_MS) {
+    period_count = 0;
+    report_statistics();
+  }
+}
+
+static void report_statistics(void)
+{
+  char str[100];
+  uint8_t count = get_connection_count();
+  uint32_t total;
+  conn_properties_t *tag;
+  sched_tag_state_t *state;
+  struct mallinfo heap = mallinfo();
+
+  // The arena only grows, so it is the heap high-water mark
+  // $HEAP,<tags>,<heap high-water bytes>,<heap in use bytes>
+  sprintf(str, "$HEAP,%u,%u,%u\n", count, (unsigned int)heap.arena, (unsigned int)heap.uordblks);
+  sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+
+  // $SCHED,<tag id>,<weight>,<served>,<skipped>,<served permille>,<avg cycles per report>,<max latency ms>
+  for (uint8_t i = 0; i < AOA_MAX_TAGS; i++) {
+    tag = get_connection_by_index(i);
+    if (tag == NULL) {
+      continue;
+    }
+    state = conn_sched(tag);
+    total = state->served + state->skipped;
+    sprintf(str, "$SCHED,%llu,%u,%lu,%lu,%lu,%lu,%lu\n",
+            conn_address_to_id(&tag->address),
+            state->weight,
+            state->served,
+            state->skipped,
+            (total > 0) ? (state->served * 1000 / total) : 1000,
+            state->avg_cycles,
+            sl_sleeptimer_tick_to_ms(state->max_latency_ticks));
+    sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+
+    // Ratios cover one reporting interval
+    state->served = 0;
+    state->skipped = 0;
+    state->max_latency_ticks = 0;
+  }
+}
@@ -0,0 +1,69 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Scheduler header file
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "conn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************************************//**
+ * @addtogroup Application
+ * @{
+ **************************************************************************************************/
+
+/***********************************************************************************************//**
+ * @addtogroup app
+ * @{
+ **************************************************************************************************/
+
+#define SCHED_PERIOD_MS               100   // Length of one budget period
+#define SCHED_CPU_BUDGET_PERCENT      60    // Share of the CPU cycles spent on report processing
+#define SCHED_MAX_CREDIT_PERIODS      2     // Unused credit a tag may carry over, in periods
+#define SCHED_REPORT_INTERVAL_MS      5000  // Interval of the $SCHED statistics lines
+#define SCHED_DEFAULT_WEIGHT          1     // Until the sync priority of the tag is applied
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+// Processes the pending IQ report of a tag
+typedef void (*sched_process_cb_t)(conn_properties_t *tag);
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void sched_init(sched_process_cb_t process_cb);
+
+void sched_submit(conn_properties_t *tag, const uint8_t *samples, uint8_t len, int8_t rssi, uint8_t channel, uint16_t event_counter);
+
+bool sched_step(void);
+
+bool sched_is_work_ready(void);
+
+void sched_set_weight(conn_properties_t *tag, uint8_t weight);
+
+/** @} (end addtogroup app) */
+/** @} (end addtogroup Application) */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* SCHED_H */
@@ -0,0 +1,1067 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Sync scheduler. Rotates the periodic advertising syncs among more tags than the
+ *         controller can follow at once, with stride scheduling weighted by priority and motion.
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sl_sleeptimer.h"
+#include "timer_wheel.h"
+#include "sl_iostream.h"
+#include "nvm3_default.h"
+#include "conn.h"
+#include "aoa_cfg.h"
+#include "cmd.h"
+#include "scan_policy.h"
+#include "sched.h"
+#include "tag_filter.h"
+#include "sync_sched.h"
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+// Entries below tag_count are in use or free, above it they were never used
+static sync_tag_t tags[SYNC_SCHED_MAX_TAGS];
+static uint8_t tag_count;
+static uint8_t eviction;  // sync_eviction_t
+static uint16_t iq_budget;
+
+// Tags by address hash, linear probing, 0xFF marks an empty bucket
+static uint8_t tag_index[SYNC_SCHED_INDEX_SIZE];
+
+static timer_wheel_timer_t slice_timer;
+static timer_wheel_timer_t report_timer;
+static timer_wheel_timer_t cache_timer;
+
+// RAM copy of the tag cache, written to NVM3 by cache_timer when dirty
+static sync_cache_t cache;
+static uint8_t cache_next;
+static bool cache_dirty;
+
+// Syncs opening, open or closing
+static uint8_t syncs_in_use;
+
+static uint32_t rotations;
+static uint32_t open_failures;
+static uint32_t evictions;
+static uint32_t admissions_rejected;
+static uint32_t reaped;
+static uint32_t resyncs;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static void slice_timer_cb(timer_wheel_timer_t *timer, void *data);
+static void report_timer_cb(timer_wheel_timer_t *timer, void *data);
+static void tag_timer_cb(timer_wheel_timer_t *timer, void *data);
+static void cache_timer_cb(timer_wheel_timer_t *timer, void *data);
+static sync_tag_t* create_tag(uint8_t index,
+                              const bd_addr *address,
+                              uint8_t address_type,
+                              uint8_t adv_sid,
+                              int8_t rssi);
+static void load_cache(void);
+static void update_cache(const sync_tag_t *tag);
+static sync_tag_t* find_by_sync(uint16_t sync);
+static sync_tag_t* find_candidate(void);
+static void fill_syncs(void);
+static bool open_sync(sync_tag_t *tag);
+static void close_sync(sync_tag_t *tag);
+static void retry_later(sync_tag_t *tag);
+static void update_motion(sync_tag_t *tag);
+static uint32_t weight(const sync_tag_t *tag);
+static uint32_t stride(const sync_tag_t *tag);
+static uint16_t select_skip(const sync_tag_t *tag);
+static uint16_t sync_timeout(const sync_tag_t *tag, uint16_t skip);
+static uint32_t min_pass(void);
+static sync_tag_t* find_victim(void);
+static bool eviction_pending(void);
+static bool admit(const sync_tag_t *victim, int8_t rssi);
+static bool drop_tag(sync_tag_t *tag);
+static void free_entry(sync_tag_t *tag);
+static void index_insert(uint8_t index);
+static void index_remove(uint8_t index);
+static sl_status_t priority_cmd(uint8_t argc, char *argv[]);
+static sl_status_t eviction_cmd(uint8_t argc, char *argv[]);
+static sl_status_t cache_cmd(uint8_t argc, char *argv[]);
+static sl_status_t budget_cmd(uint8_t argc, char *argv[]);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+void sync_sched_init(void)
+{
+  tag_count = 0;
+  syncs_in_use = 0;
+  rotations = 0;
+  open_failures = 0;
+  evictions = 0;
+  admissions_rejected = 0;
+  reaped = 0;
+  resyncs = 0;
+  memset(tag_index, 0xFF, sizeof(tag_index));
+
+  if (nvm3_readData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_EVICTION, &eviction, sizeof(eviction)) != ECODE_NVM3_OK
+      || eviction > SYNC_EVICT_LOWEST_PRIORITY) {
+    eviction = SYNC_SCHED_DEFAULT_EVICTION;
+  }
+  if (nvm3_readData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_IQ_BUDGET, &iq_budget, sizeof(iq_budget)) != ECODE_NVM3_OK) {
+    iq_budget = SYNC_SCHED_DEFAULT_IQ_BUDGET;
+  }
+
+  cmd_register("PRIORITY", priority_cmd);
+  cmd_register("EVICT", eviction_cmd);
+  cmd_register("CACHE", cache_cmd);
+  cmd_register("BUDGET", budget_cmd);
+
+  timer_wheel_start(&slice_timer, SYNC_SCHED_SLICE_MS, SYNC_SCHED_SLICE_MS, slice_timer_cb, NULL);
+  timer_wheel_start(&report_timer,
+                    SYNC_SCHED_REPORT_INTERVAL_MS,
+                    SYNC_SCHED_REPORT_INTERVAL_MS,
+                    report_timer_cb,
+                    NULL);
+  timer_wheel_start(&cache_timer,
+                    SYNC_SCHED_CACHE_WRITE_MS,
+                    SYNC_SCHED_CACHE_WRITE_MS,
+                    cache_timer_cb,
+                    NULL);
+
+  load_cache();
+}
+
+void sync_sched_start(void)
+{
+  // Cached tags are synced without waiting to be discovered again
+  fill_syncs();
+}
+
+sync_tag_t* sync_sched_seen(const bd_addr *address, uint8_t address_type, int8_t rssi)
+{
+  uint32_t bucket = conn_address_hash(address, address_type) & (SYNC_SCHED_INDEX_SIZE - 1);
+  uint8_t index;
+
+  while ((index = tag_index[bucket]) != 0xFF) {
+    if (tags[index].address_type == address_type
+        && 0 == memcmp(address, &tags[index].address, sizeof(bd_addr))) {
+      tags[index].last_seen_tick = sl_sleeptimer_get_tick_count();
+      tags[index].rssi = (int8_t)((tags[index].rssi * 3 + rssi) / 4);
+      // Still advertising, the open timeout is left running while opening
+      if (tags[index].state == SYNC_STATE_IDLE || tags[index].state == SYNC_STATE_SYNCED) {
+        timer_wheel_start(&tags[index].timer, SYNC_SCHED_SEEN_TIMEOUT_MS, 0, tag_timer_cb, &tags[index]);
+      }
+      return &tags[index];
+    }
+    bucket = (bucket + 1) & (SYNC_SCHED_INDEX_SIZE - 1);
+  }
+  return NULL;
+}
+
+sync_tag_t* sync_sched_add(const bd_addr *address, uint8_t address_type, uint8_t adv_sid, int8_t rssi)
+{
+  sync_tag_t *tag = sync_sched_seen(address, address_type, rssi);
+  sync_tag_t *victim;
+  uint8_t index;
+
+  if (tag != NULL) {
+    tag->adv_sid = adv_sid;
+    return tag;
+  }
+
+  // Reuse a free entry, or an unused one
+  for (index = 0; index < tag_count && tags[index].state != SYNC_STATE_FREE; index++) {
+  }
+  if (index >= SYNC_SCHED_MAX_TAGS) {
+    // An entry is already being freed, new tags wait for it instead of evicting one more
+    if (eviction_pending()) {
+      return NULL;
+    }
+    // All in use: make room if the new tag is worth more than the victim. A victim holding a sync
+    // gives up its entry when the sync closes, the new tag is taken in at its next advertisement.
+    victim = find_victim();
+    if (victim == NULL || !admit(victim, rssi)) {
+      admissions_rejected++;
+      return NULL;
+    }
+    evictions++;
+    if (!drop_tag(victim)) {
+      return NULL;
+    }
+    index = (uint8_t)(victim - tags);
+  }
+
+  tag = create_tag(index, address, address_type, adv_sid, rssi);
+
+  // A free sync is taken right away, without waiting for the next slice
+  fill_syncs();
+  return tag;
+}
+
+sync_tag_t* sync_sched_opened(uint16_t sync, uint16_t adv_interval, uint8_t adv_phy)
+{
+  sync_tag_t *tag = find_by_sync(sync);
+
+  if (tag == NULL || tag->state != SYNC_STATE_OPENING) {
+    return NULL;
+  }
+  tag->adv_phy = adv_phy;
+  // There is no CTE on the Coded PHY. The train is tried again with backoff, the tag may move it.
+  if (adv_phy == gap_coded_phy) {
+    timer_wheel_stop(&tag->timer);
+    tag->state = SYNC_STATE_CLOSING;
+    tag->retry = true;
+    return NULL;
+  }
+  tag->state = SYNC_STATE_SYNCED;
+  tag->slices = 0;
+  tag->failures = 0;
+  tag->adv_interval = adv_interval;
+  timer_wheel_start(&tag->timer, SYNC_SCHED_SEEN_TIMEOUT_MS, 0, tag_timer_cb, tag);
+  update_cache(tag);
+  return tag;
+}
+
+void sync_sched_closed(uint16_t sync)
+{
+  sync_tag_t *tag = find_by_sync(sync);
+  bool lost;
+  bool failed;
+
+  if (tag == NULL) {
+    return;
+  }
+  lost = (tag->state == SYNC_STATE_SYNCED);
+  // Not established by the controller, or given up on by the open timeout
+  failed = (tag->state == SYNC_STATE_OPENING || tag->retry);
+  tag->state = SYNC_STATE_IDLE;
+  tag->slices = 0;
+  tag->retry = false;
+  tag->sync_handle = CONNECTION_HANDLE_INVALID;
+  syncs_in_use--;
+  if (tag->evict) {
+    free_entry(tag);
+  } else if (failed) {
+    retry_later(tag);
+  } else {
+    if (lost) {
+      // Most likely briefly out of range: the tag's entry keeps its address and SID, its sync is
+      // reopened directly, ahead of the waiting tags, without having to be discovered again
+      tag->resync = true;
+      tag->lost_tick = sl_sleeptimer_get_tick_count();
+      tag->pass = min_pass() - 1;
+    } else if (tag->reopen) {
+      // Reopened right away with its new skip
+      tag->pass = min_pass() - 1;
+    }
+    tag->reopen = false;
+    timer_wheel_start(&tag->timer, SYNC_SCHED_SEEN_TIMEOUT_MS, 0, tag_timer_cb, tag);
+  }
+
+  fill_syncs();
+}
+
+void sync_sched_filter_changed(void)
+{
+  for (uint8_t i = 0; i < tag_count; i++) {
+    if (tags[i].state != SYNC_STATE_FREE && !tag_filter_accept(&tags[i].address)) {
+      drop_tag(&tags[i]);
+    }
+  }
+  // Syncs released right away go to the accepted tags
+  fill_syncs();
+}
+
+void sync_sched_get_syncs(uint8_t *opening, uint8_t *in_use)
+{
+  *opening = 0;
+  for (uint8_t i = 0; i < tag_count; i++) {
+    if (tags[i].state == SYNC_STATE_OPENING) {
+      (*opening)++;
+    }
+  }
+  *in_use = syncs_in_use;
+}
+
+uint16_t sync_sched_get_waiting_interval(void)
+{
+  uint16_t longest = 0;
+  uint16_t interval;
+
+  for (uint8_t i = 0; i < tag_count; i++) {
+    if (tags[i].state == SYNC_STATE_IDLE || tags[i].state == SYNC_STATE_BACKOFF) {
+      interval = (tags[i].adv_interval > 0) ? tags[i].adv_interval : SYNC_SCHED_ASSUMED_INTERVAL;
+      if (interval > longest) {
+        longest = interval;
+      }
+    }
+  }
+  return longest;
+}
+
+void sync_sched_iq_received(uint16_t sync)
+{
+  sync_tag_t *tag = find_by_sync(sync);
+  char str[64];
+
+  if (tag == NULL) {
+    return;
+  }
+  tag->iq_reports++;
+  // A synced tag is alive as long as its CTEs arrive, whether the scanner sees it or not
+  tag->last_seen_tick = sl_sleeptimer_get_tick_count();
+
+  // CTE reports interrupted by a sync loss, from the loss until the first report of the new sync.
+  // The sync timeout passes between the last report and the loss.
+  // $RESYNC,<cte tx dev-id>,<ms since the sync loss>
+  if (tag->resync) {
+    tag->resync = false;
+    resyncs++;
+    sprintf(str, "$RESYNC,%llu,%lu\n",
+            conn_address_to_id(&tag->address),
+            sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count() - tag->lost_tick));
+    sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+  }
+
+  if (tag->iq_received) {
+    return;
+  }
+  tag->iq_received = true;
+
+  // Time to the first IQ report of each tag, to compare starts with and without the tag cache
+  // $FIRSTIQ,<cte tx dev-id>,<ms since reset>,<1 if restored from the cache>
+  sprintf(str, "$FIRSTIQ,%llu,%lu,%u\n",
+          conn_address_to_id(&tag->address),
+          sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count()),
+          tag->cached);
+  sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+static void slice_timer_cb(timer_wheel_timer_t *timer, void *data)
+{
+  sync_tag_t *candidate;
+  sync_tag_t *victim = NULL;
+  uint16_t skip;
+
+  (void)timer;
+  (void)data;
+
+  for (uint8_t i = 0; i < tag_count; i++) {
+    sync_tag_t *tag = &tags[i];
+
+    if (tag->state == SYNC_STATE_SYNCED) {
+      tag->slices++;
+      // Synced tags pay for their sync time, the faster the lower their weight
+      update_motion(tag);
+      tag->pass += stride(tag);
+      if (tag->slices >= SYNC_SCHED_DWELL_SLICES
+          && (victim == NULL || tag->pass > victim->pass)) {
+        victim = tag;
+      }
+    }
+  }
+
+  fill_syncs();
+
+  // All syncs busy: rotate out the tag furthest ahead if a waiting tag is behind it
+  candidate = find_candidate();
+  if (syncs_in_use >= SYNC_SCHED_MAX_SYNCS && candidate != NULL
+      && victim != NULL && (int32_t)(candidate->pass - victim->pass) < 0) {
+    rotations++;
+    close_sync(victim);
+  }
+
+  // The skip only changes when a sync is opened. Reopen syncs at once for a rate higher by half or
+  // more, a tag that started moving, and after a while for a rate lower by half or more.
+  for (uint8_t i = 0; i < tag_count; i++) {
+    sync_tag_t *tag = &tags[i];
+
+    if (tag->state != SYNC_STATE_SYNCED) {
+      continue;
+    }
+    skip = select_skip(tag);
+    if ((3 * (skip + 1) <= 2 * (tag->skip + 1))
+        || (skip + 1 >= 2 * (tag->skip + 1) && tag->slices >= SYNC_SCHED_RETUNE_SLICES)) {
+      tag->reopen = true;
+      close_sync(tag);
+      if (tag->state == SYNC_STATE_IDLE) {
+        tag->reopen = false;
+      }
+    }
+  }
+}
+
+static void tag_timer_cb(timer_wheel_timer_t *timer, void *data)
+{
+  sync_tag_t *tag = (sync_tag_t *)data;
+  uint32_t quiet_ms;
+
+  (void)timer;
+
+  switch (tag->state) {
+    case SYNC_STATE_OPENING:
+      // Out of range or not advertising periodically any more, give the sync to another tag
+      tag->retry = true;
+      close_sync(tag);
+      if (tag->state == SYNC_STATE_IDLE) {
+        tag->retry = false;
+        retry_later(tag);
+      }
+      break;
+
+    case SYNC_STATE_SYNCED:
+      // Still reporting CTEs, the timer is re-armed here instead of at every report
+      quiet_ms = sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count() - tag->last_seen_tick);
+      if (quiet_ms < SYNC_SCHED_SEEN_TIMEOUT_MS) {
+        timer_wheel_start(&tag->timer, SYNC_SCHED_SEEN_TIMEOUT_MS - quiet_ms, 0, tag_timer_cb, tag);
+        break;
+      }
+      // Gone quiet: release the sync and the entry now rather than after the sync timeout
+      reaped++;
+      tag->evict = true;
+      close_sync(tag);
+      if (tag->state == SYNC_STATE_IDLE) {
+        free_entry(tag);
+      }
+      fill_syncs();
+      break;
+
+    case SYNC_STATE_IDLE:
+      reaped++;
+      free_entry(tag);
+      break;
+
+    case SYNC_STATE_BACKOFF:
+      // Retried at the next free sync, unless the tag went quiet meanwhile
+      quiet_ms = sl_sleeptimer_tick_to_ms(sl_sleeptimer_get_tick_count() - tag->last_seen_tick);
+      if (quiet_ms >= SYNC_SCHED_SEEN_TIMEOUT_MS) {
+        reaped++;
+        free_entry(tag);
+        break;
+      }
+      tag->state = SYNC_STATE_IDLE;
+      timer_wheel_start(&tag->timer, SYNC_SCHED_SEEN_TIMEOUT_MS - quiet_ms, 0, tag_timer_cb, tag);
+      fill_syncs();
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void cache_timer_cb(timer_wheel_timer_t *timer, void *data)
+{
+  (void)timer;
+  (void)data;
+
+  if (!cache_dirty) {
+    return;
+  }
+  if (nvm3_writeData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_TAG_CACHE, &cache, sizeof(cache)) == ECODE_NVM3_OK) {
+    cache_dirty = false;
+  }
+}
+
+static sync_tag_t* create_tag(uint8_t index,
+                              const bd_addr *address,
+                              uint8_t address_type,
+                              uint8_t adv_sid,
+                              int8_t rssi)
+{
+  sync_tag_t *tag = &tags[index];
+
+  memset(tag, 0, sizeof(*tag));
+  tag->address = *address;
+  tag->address_type = address_type;
+  tag->adv_sid = adv_sid;
+  tag->state = SYNC_STATE_IDLE;
+  tag->priority = SYNC_SCHED_DEFAULT_PRIORITY;
+  tag->sync_handle = CONNECTION_HANDLE_INVALID;
+  tag->last_seen_tick = sl_sleeptimer_get_tick_count();
+  tag->rssi = rssi;
+  // Start level with the tags already known, neither starving them nor being starved
+  tag->pass = min_pass();
+  timer_wheel_start(&tag->timer, SYNC_SCHED_SEEN_TIMEOUT_MS, 0, tag_timer_cb, tag);
+
+  index_insert(index);
+  if (index == tag_count) {
+    tag_count++;
+  }
+  return tag;
+}
+
+static void load_cache(void)
+{
+  sync_tag_t *tag;
+
+  if (nvm3_readData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_TAG_CACHE, &cache, sizeof(cache)) != ECODE_NVM3_OK
+      || cache.count > SYNC_SCHED_CACHE_SIZE) {
+    memset(&cache, 0, sizeof(cache));
+  }
+  cache_next = 0;
+  cache_dirty = false;
+
+  // Known as if just discovered, reaped like any other tag if they do not show up
+  for (uint8_t i = 0; i < cache.count && tag_count < SYNC_SCHED_MAX_TAGS; i++) {
+    // Cached before the tag was denied, or left off the allow list
+    if (!tag_filter_accept(&cache.entries[i].address)) {
+      continue;
+    }
+    tag = create_tag(tag_count,
+                     &cache.entries[i].address,
+                     cache.entries[i].address_type,
+                     cache.entries[i].adv_sid,
+                     SYNC_SCHED_UNKNOWN_RSSI);
+    tag->adv_interval = cache.entries[i].adv_interval;
+    tag->cached = true;
+  }
+}
+
+static void update_cache(const sync_tag_t *tag)
+{
+  sync_cache_entry_t *entry = NULL;
+
+  for (uint8_t i = 0; i < cache.count; i++) {
+    if (cache.entries[i].address_type == tag->address_type
+        && 0 == memcmp(&cache.entries[i].address, &tag->address, sizeof(bd_addr))) {
+      entry = &cache.entries[i];
+      break;
+    }
+  }
+
+  if (entry != NULL) {
+    // Resyncs of a cached tag cost no write
+    if (entry->adv_sid == tag->adv_sid && entry->adv_interval == tag->adv_interval) {
+      return;
+    }
+  } else if (cache.count < SYNC_SCHED_CACHE_SIZE) {
+    entry = &cache.entries[cache.count++];
+  } else {
+    // Full: replace the entries in turn
+    entry = &cache.entries[cache_next];
+    cache_next = (cache_next + 1) % SYNC_SCHED_CACHE_SIZE;
+  }
+
+  entry->address = tag->address;
+  entry->address_type = tag->address_type;
+  entry->adv_sid = tag->adv_sid;
+  entry->adv_interval = tag->adv_interval;
+  cache_dirty = true;
+}
+
+static sync_tag_t* find_by_sync(uint16_t sync)
+{
+  for (uint8_t i = 0; i < tag_count; i++) {
+    if ((tags[i].state == SYNC_STATE_OPENING || tags[i].state == SYNC_STATE_SYNCED
+         || tags[i].state == SYNC_STATE_CLOSING)
+        && tags[i].sync_handle == sync) {
+      return &tags[i];
+    }
+  }
+  return NULL;
+}
+
+static sync_tag_t* find_candidate(void)
+{
+  sync_tag_t *candidate = NULL;
+
+  // Waiting tag with the lowest pass, tags that stopped advertising are reaped by their timer
+  for (uint8_t i = 0; i < tag_count; i++) {
+    if (tags[i].state == SYNC_STATE_IDLE
+        && (candidate == NULL || (int32_t)(tags[i].pass - candidate->pass) < 0)) {
+      candidate = &tags[i];
+    }
+  }
+  return candidate;
+}
+
+static void fill_syncs(void)
+{
+  sync_tag_t *candidate;
+
+  while (syncs_in_use < SYNC_SCHED_MAX_SYNCS && (candidate = find_candidate()) != NULL) {
+    if (!open_sync(candidate)) {
+      break;
+    }
+  }
+}
+
+static bool open_sync(sync_tag_t *tag)
+{
+  sl_status_t sc;
+  uint16_t sync;
+
+  // The parameters apply to the syncs opened next
+  tag->skip = select_skip(tag);
+  sc = sl_bt_sync_set_parameters(tag->skip, sync_timeout(tag, tag->skip), 0);
+  if (sc == SL_STATUS_OK) {
+    sc = sl_bt_sync_open(tag->address, tag->address_type, tag->adv_sid, &sync);
+  }
+  tag->slices = 0;
+  if (sc != SL_STATUS_OK) {
+    retry_later(tag);
+    return false;
+  }
+  tag->state = SYNC_STATE_OPENING;
+  tag->sync_handle = sync;
+  syncs_in_use++;
+  timer_wheel_start(&tag->timer, SYNC_SCHED_OPEN_TIMEOUT_MS, 0, tag_timer_cb, tag);
+  // The scanner has to find the tag's sync info
+  scan_policy_update();
+  return true;
+}
+
+static void close_sync(sync_tag_t *tag)
+{
+  tag->slices = 0;
+  if (sl_bt_sync_close(tag->sync_handle) == SL_STATUS_OK) {
+    // The sync is released by the sync closed event
+    tag->state = SYNC_STATE_CLOSING;
+    timer_wheel_stop(&tag->timer);
+  } else {
+    tag->state = SYNC_STATE_IDLE;
+    tag->sync_handle = CONNECTION_HANDLE_INVALID;
+    syncs_in_use--;
+    timer_wheel_start(&tag->timer, SYNC_SCHED_SEEN_TIMEOUT_MS, 0, tag_timer_cb, tag);
+    scan_policy_update();
+  }
+}
+
+// Failed sync of a tag holding none, retried after an exponential backoff. The backoff stops
+// growing rather than the tag being dropped, it would only be discovered again right away.
+static void retry_later(sync_tag_t *tag)
+{
+  open_failures++;
+  if (tag->resync && tag->failures == 0) {
+    scan_policy_resync_failed();
+  }
+  tag->state = SYNC_STATE_BACKOFF;
+  timer_wheel_start(&tag->timer, (uint32_t)SYNC_SCHED_RETRY_MS << tag->failures, 0, tag_timer_cb, tag);
+  if (tag->failures < SYNC_SCHED_MAX_BACKOFF_STEPS) {
+    tag->failures++;
+  }
+}
+
+static void update_motion(sync_tag_t *tag)
+{
+  conn_properties_t *conn = get_connection_by_handle(tag->sync_handle);
+  aoa_tag_state_t *state;
+  float delta;
+  int32_t diff;
+
+  // The angles are only known when they are estimated on the locator, a single float read
+  // racing with the DSP task gives at worst one off sample of the smoothed motion
+  if (conn == NULL) {
+    return;
+  }
+  state = conn_aoa_state(conn);
+  if (!state->filter_valid) {
+    return;
+  }
+  tag->motion_valid = true;
+  delta = fabsf(state->azimuth - tag->azimuth);
+  if (delta > 180.0f) {
+    delta = 360.0f - delta;
+  }
+  delta += fabsf(state->elevation - tag->elevation);
+  if (delta > SYNC_SCHED_MAX_MOTION) {
+    delta = SYNC_SCHED_MAX_MOTION;
+  }
+  // Smoothed, rounded towards the new value so that it settles on it, also back at 0
+  diff = (int32_t)delta - tag->motion;
+  tag->motion = (uint8_t)(tag->motion + (diff + ((diff > 0) ? 3 : ((diff < 0) ? -3 : 0))) / 4);
+  tag->azimuth = state->azimuth;
+  tag->elevation = state->elevation;
+}
+
+static uint32_t weight(const sync_tag_t *tag)
+{
+  return (uint32_t)tag->priority * (SYNC_SCHED_MOTION_BASE + tag->motion);
+}
+
+static uint32_t stride(const sync_tag_t *tag)
+{
+  return SYNC_SCHED_STRIDE / weight(tag);
+}
+
+static uint16_t select_skip(const sync_tag_t *tag)
+{
+  uint32_t skip = 0;
+  uint32_t weights = 0;
+  uint32_t rate;
+  uint32_t share;
+
+  // Static tags, as far as the locator knows, need fewer samples the lower their priority
+  if (tag->motion_valid && tag->motion < SYNC_SCHED_MOVING_MOTION) {
+    skip = SYNC_SCHED_STATIC_SKIP >> (tag->priority - 1);
+  }
+
+  // Share of the output budget among the tags holding a sync, in the proportion of their sync time.
+  // Rates in reports per 1000 s, the advertising interval is in 1.25 ms.
+  if (iq_budget > 0 && tag->adv_interval > 0) {
+    for (uint8_t i = 0; i < tag_count; i++) {
+      if (&tags[i] == tag || tags[i].state == SYNC_STATE_OPENING || tags[i].state == SYNC_STATE_SYNCED
+          || tags[i].state == SYNC_STATE_CLOSING) {
+        weights += weight(&tags[i]);
+      }
+    }
+    rate = 800000UL / tag->adv_interval;
+    share = (uint32_t)iq_budget * 1000 * weight(tag) / weights;
+    if (share == 0) {
+      share = 1;
+    }
+    if ((rate + share - 1) / share - 1 > skip) {
+      skip = (rate + share - 1) / share - 1;
+    }
+  }
+
+  return (skip > SYNC_SCHED_MAX_SKIP) ? SYNC_SCHED_MAX_SKIP : (uint16_t)skip;
+}
+
+// Some periodic advertisements more than the skipped ones, in 10 ms
+static uint16_t sync_timeout(const sync_tag_t *tag, uint16_t skip)
+{
+  uint32_t timeout = ((uint32_t)(skip + 1) * tag->adv_interval * SYNC_SCHED_TIMEOUT_EVENTS * 125 + 999) / 1000;
+
+  if (timeout < SYNC_SCHED_MIN_TIMEOUT) {
+    timeout = SYNC_SCHED_MIN_TIMEOUT;
+  }
+  return (timeout > SYNC_SCHED_MAX_TIMEOUT) ? SYNC_SCHED_MAX_TIMEOUT : (uint16_t)timeout;
+}
+
+static uint32_t min_pass(void)
+{
+  uint32_t pass = 0;
+  bool found = false;
+
+  for (uint8_t i = 0; i < tag_count; i++) {
+    if (tags[i].state != SYNC_STATE_FREE && (!found || (int32_t)(tags[i].pass - pass) < 0)) {
+      pass = tags[i].pass;
+      found = true;
+    }
+  }
+  return pass;
+}
+
+static sync_tag_t* find_victim(void)
+{
+  sync_tag_t *victim = NULL;
+  sync_tag_t *tag;
+
+  for (uint8_t i = 0; i < tag_count; i++) {
+    tag = &tags[i];
+    // Entries already on their way out do not count twice
+    if (tag->state == SYNC_STATE_FREE || tag->evict) {
+      continue;
+    }
+    if (victim == NULL) {
+      victim = tag;
+      continue;
+    }
+    switch (eviction) {
+      case SYNC_EVICT_WEAKEST_RSSI:
+        if (tag->rssi < victim->rssi) {
+          victim = tag;
+        }
+        break;
+
+      case SYNC_EVICT_LOWEST_PRIORITY:
+        if (tag->priority < victim->priority
+            || (tag->priority == victim->priority
+                && (int32_t)(tag->last_seen_tick - victim->last_seen_tick) < 0)) {
+          victim = tag;
+        }
+        break;
+
+      default:
+        if ((int32_t)(tag->last_seen_tick - victim->last_seen_tick) < 0) {
+          victim = tag;
+        }
+        break;
+    }
+  }
+  return victim;
+}
+
+static bool eviction_pending(void)
+{
+  for (uint8_t i = 0; i < tag_count; i++) {
+    if (tags[i].state != SYNC_STATE_FREE && tags[i].evict) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool admit(const sync_tag_t *victim, int8_t rssi)
+{
+  bool stale = (sl_sleeptimer_get_tick_count() - victim->last_seen_tick)
+               >= sl_sleeptimer_ms_to_tick(SYNC_SCHED_SEEN_TIMEOUT_MS);
+
+  switch (eviction) {
+    case SYNC_EVICT_WEAKEST_RSSI:
+      return stale || rssi > victim->rssi + SYNC_SCHED_EVICT_RSSI_MARGIN;
+
+    case SYNC_EVICT_LOWEST_PRIORITY:
+      return stale || victim->priority < SYNC_SCHED_DEFAULT_PRIORITY;
+
+    default:
+      return stale;
+  }
+}
+
+// Free the tag's entry, or once its sync has closed. True if freed right away.
+static bool drop_tag(sync_tag_t *tag)
+{
+  if (tag->state != SYNC_STATE_IDLE && tag->state != SYNC_STATE_BACKOFF) {
+    tag->evict = true;
+    if (tag->state != SYNC_STATE_CLOSING) {
+      close_sync(tag);
+    }
+    if (tag->state != SYNC_STATE_IDLE) {
+      return false;
+    }
+  }
+  free_entry(tag);
+  return true;
+}
+
+static void free_entry(sync_tag_t *tag)
+{
+  timer_wheel_stop(&tag->timer);
+  index_remove((uint8_t)(tag - tags));
+  tag->state = SYNC_STATE_FREE;
+  tag->evict = false;
+}
+
+static void index_insert(uint8_t index)
+{
+  uint32_t bucket = conn_address_hash(&tags[index].address, tags[index].address_type)
+                    & (SYNC_SCHED_INDEX_SIZE - 1);
+
+  while (tag_index[bucket] != 0xFF) {
+    bucket = (bucket + 1) & (SYNC_SCHED_INDEX_SIZE - 1);
+  }
+  tag_index[bucket] = index;
+}
+
+static void index_remove(uint8_t index)
+{
+  uint32_t bucket = conn_address_hash(&tags[index].address, tags[index].address_type)
+                    & (SYNC_SCHED_INDEX_SIZE - 1);
+  uint32_t next;
+  uint32_t home;
+
+  while (tag_index[bucket] != index) {
+    if (tag_index[bucket] == 0xFF) {
+      return;
+    }
+    bucket = (bucket + 1) & (SYNC_SCHED_INDEX_SIZE - 1);
+  }
+
+  // Move later entries of the probe run back into the gap, as in the tag table index
+  next = bucket;
+  while (1) {
+    next = (next + 1) & (SYNC_SCHED_INDEX_SIZE - 1);
+    if (tag_index[next] == 0xFF) {
+      break;
+    }
+    home = conn_address_hash(&tags[tag_index[next]].address, tags[tag_index[next]].address_type)
+           & (SYNC_SCHED_INDEX_SIZE - 1);
+    if (((next - home) & (SYNC_SCHED_INDEX_SIZE - 1)) >= ((next - bucket) & (SYNC_SCHED_INDEX_SIZE - 1))) {
+      tag_index[bucket] = tag_index[next];
+      bucket = next;
+    }
+  }
+  tag_index[bucket] = 0xFF;
+}
+
+static void report_timer_cb(timer_wheel_timer_t *timer, void *data)
+{
+  char str[96];
+  uint8_t known = 0;
+  uint8_t backoff = 0;
+
+  (void)timer;
+  (void)data;
+
+  for (uint8_t i = 0; i < tag_count; i++) {
+    if (tags[i].state != SYNC_STATE_FREE) {
+      known++;
+    }
+    if (tags[i].state == SYNC_STATE_BACKOFF) {
+      backoff++;
+    }
+  }
+
+  // $SYNC,<known tags>,<syncs in use>,<rotations>,<failed sync attempts>,<evictions>,
+  //       <rejected new tags>,<tags dropped for inactivity>,<tags waiting to retry a sync>,
+  //       <lost syncs resynced>
+  sprintf(str, "$SYNC,%u,%u,%lu,%lu,%lu,%lu,%lu,%u,%lu\n", known, syncs_in_use, rotations, open_failures,
+          evictions, admissions_rejected, reaped, backoff, resyncs);
+  sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+
+  // Effective sampling rate of each synced tag
+  // $RATE,<cte tx dev-id>,<adv interval in 1.25 ms>,<skip>,<motion>,<IQ reports since the last line>,
+  // <periodic PHY>
+  for (uint8_t i = 0; i < tag_count; i++) {
+    if (tags[i].state == SYNC_STATE_SYNCED) {
+      sprintf(str, "$RATE,%llu,%u,%u,%u,%u,%u\n",
+              conn_address_to_id(&tags[i].address),
+              tags[i].adv_interval,
+              tags[i].skip,
+              tags[i].motion,
+              tags[i].iq_reports,
+              tags[i].adv_phy);
+      sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    }
+    tags[i].iq_reports = 0;
+  }
+}
+
+// $PRIORITY                          list the known tags as $PRIORITY,<tag id>,<priority>,<state>
+// $PRIORITY,<tag id>,<priority>      set the priority (1 ... 15) of a known tag
+static sl_status_t priority_cmd(uint8_t argc, char *argv[])
+{
+  char str[48];
+  char *end;
+  uint64_t id;
+  long priority;
+  conn_properties_t *conn;
+
+  if (argc == 1) {
+    for (uint8_t i = 0; i < tag_count; i++) {
+      if (tags[i].state == SYNC_STATE_FREE) {
+        continue;
+      }
+      sprintf(str, "$PRIORITY,%llu,%u,%u\n",
+              conn_address_to_id(&tags[i].address),
+              tags[i].priority,
+              tags[i].state);
+      sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    }
+    return SL_STATUS_OK;
+  }
+
+  if (argc != 3) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  id = strtoull(argv[1], &end, 10);
+  if (end == argv[1] || *end != '\0') {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  priority = strtol(argv[2], &end, 10);
+  if (end == argv[2] || *end != '\0') {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  if (priority < 1 || priority > SYNC_SCHED_MAX_PRIORITY) {
+    return SL_STATUS_INVALID_RANGE;
+  }
+
+  for (uint8_t i = 0; i < tag_count; i++) {
+    if (tags[i].state != SYNC_STATE_FREE && conn_address_to_id(&tags[i].address) == id) {
+      tags[i].priority = (uint8_t)priority;
+      // Also the share of the processing budget of a synced tag
+      conn = get_connection_by_handle(tags[i].sync_handle);
+      if (tags[i].state == SYNC_STATE_SYNCED && conn != NULL) {
+        sched_set_weight(conn, (uint8_t)priority);
+      }
+      return SL_STATUS_OK;
+    }
+  }
+  return SL_STATUS_NOT_FOUND;
+}
+
+// $EVICT             print the eviction policy
+// $EVICT,<policy>    STALE, RSSI or PRIORITY, see sync_eviction_t
+static sl_status_t eviction_cmd(uint8_t argc, char *argv[])
+{
+  static const char *names[] = { "STALE", "RSSI", "PRIORITY" };
+  char str[24];
+
+  if (argc == 1) {
+    sprintf(str, "$EVICT,%s\n", names[eviction]);
+    sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    return SL_STATUS_OK;
+  }
+
+  if (argc != 2) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  for (uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strcmp(argv[1], names[i]) == 0) {
+      eviction = i;
+      if (nvm3_writeData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_EVICTION, &eviction, sizeof(eviction)) != ECODE_NVM3_OK) {
+        return SL_STATUS_FAIL;
+      }
+      return SL_STATUS_OK;
+    }
+  }
+  return SL_STATUS_INVALID_PARAMETER;
+}
+
+// $CACHE          print the number of cached tags
+// $CACHE,CLEAR    empty the tag cache, the next start rediscovers all tags by scanning
+static sl_status_t cache_cmd(uint8_t argc, char *argv[])
+{
+  char str[24];
+
+  if (argc == 1) {
+    sprintf(str, "$CACHE,%u\n", cache.count);
+    sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    return SL_STATUS_OK;
+  }
+
+  if (argc != 2 || strcmp(argv[1], "CLEAR") != 0) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  memset(&cache, 0, sizeof(cache));
+  cache_next = 0;
+  cache_dirty = false;
+  if (nvm3_writeData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_TAG_CACHE, &cache, sizeof(cache)) != ECODE_NVM3_OK) {
+    return SL_STATUS_FAIL;
+  }
+  return SL_STATUS_OK;
+}
+
+// $BUDGET                                 current budget
+// $BUDGET,<IQ reports per second>         limit of all tags together, 0 for no limit
+static sl_status_t budget_cmd(uint8_t argc, char *argv[])
+{
+  char str[24];
+  char *end;
+  unsigned long budget;
+
+  if (argc == 1) {
+    sprintf(str, "$BUDGET,%u\n", iq_budget);
+    sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    return SL_STATUS_OK;
+  }
+
+  if (argc != 2) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  budget = strtoul(argv[1], &end, 10);
+  if (end == argv[1] || *end != '\0' || budget > UINT16_MAX) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+  iq_budget = (uint16_t)budget;
+  if (nvm3_writeData(nvm3_defaultHandle, AOA_CFG_NVM3_KEY_IQ_BUDGET, &iq_budget, sizeof(iq_budget)) != ECODE_NVM3_OK) {
+    return SL_STATUS_FAIL;
+  }
+  return SL_STATUS_OK;
+}
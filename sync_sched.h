@@ -0,0 +1,191 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Sync scheduler header file
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef SYNC_SCHED_H
+#define SYNC_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sl_bt_api.h"
+#include "sl_bluetooth_config.h"
+#include "aoa.h"
+#include "timer_wheel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************************************//**
+ * @addtogroup Application
+ * @{
+ **************************************************************************************************/
+
+/***********************************************************************************************//**
+ * @addtogroup app
+ * @{
+ **************************************************************************************************/
+
+// Tags known to the locator, more than can be synchronized at once
+#define SYNC_SCHED_MAX_TAGS           32
+#define SYNC_SCHED_INDEX_SIZE         64    // Power of two, at least twice SYNC_SCHED_MAX_TAGS
+
+// Periodic advertising syncs rotated among the known tags
+#if (SL_BT_CONFIG_MAX_PERIODIC_ADVERTISING_SYNC < AOA_MAX_TAGS)
+#define SYNC_SCHED_MAX_SYNCS          SL_BT_CONFIG_MAX_PERIODIC_ADVERTISING_SYNC
+#else
+#define SYNC_SCHED_MAX_SYNCS          AOA_MAX_TAGS
+#endif
+
+#define SYNC_SCHED_SLICE_MS           1000  // Rotation decisions are taken once per slice
+#define SYNC_SCHED_DWELL_SLICES       3     // Slices a tag keeps its sync before it can be rotated out
+#define SYNC_SCHED_OPEN_TIMEOUT_MS    3000  // Time to wait for a sync to be established
+#define SYNC_SCHED_SEEN_TIMEOUT_MS    10000 // Tags not seen (synced: no CTE report) for this long are dropped
+#define SYNC_SCHED_RETRY_MS           1000  // Backoff after the first failed sync, doubled per failure
+#define SYNC_SCHED_MAX_BACKOFF_STEPS  5     // Longest backoff, SYNC_SCHED_RETRY_MS << 5 = 32 s
+#define SYNC_SCHED_REPORT_INTERVAL_MS 5000  // Interval of the $SYNC statistics lines
+
+// Share of sync time: priority * (SYNC_SCHED_MOTION_BASE + motion), motion in degrees per slice
+#define SYNC_SCHED_DEFAULT_PRIORITY   1
+#define SYNC_SCHED_MAX_PRIORITY       15
+#define SYNC_SCHED_MOTION_BASE        4
+#define SYNC_SCHED_MAX_MOTION         12
+#define SYNC_SCHED_STRIDE             65536
+
+// Tags synced most recently, kept in NVM3 to resync directly after a reset. Written at most
+// once per SYNC_SCHED_CACHE_WRITE_MS, and only if changed, to spare the flash.
+#define SYNC_SCHED_CACHE_SIZE         16
+#define SYNC_SCHED_CACHE_WRITE_MS     60000
+#define SYNC_SCHED_UNKNOWN_RSSI       (-127)
+#define SYNC_SCHED_ASSUMED_INTERVAL   80    // Assumed until the first sync of a tag, 100 ms in 1.25 ms
+
+// Periodic advertisements skipped per tag, applied when its sync is opened. Static tags are sampled
+// at a lower rate, and the IQ reports of all synced tags can be limited to an output budget shared
+// like the sync time. The sync timeout follows the skip.
+#define SYNC_SCHED_MOVING_MOTION      2     // Degrees per slice from which a tag gets its full rate
+#define SYNC_SCHED_STATIC_SKIP        4     // Skip of static tags of the default priority, halved
+                                            // per priority step
+#define SYNC_SCHED_MAX_SKIP           49
+#define SYNC_SCHED_TIMEOUT_EVENTS     6     // Sync timeout in periodic advertisements taken in
+#define SYNC_SCHED_MIN_TIMEOUT        100   // Sync timeout at least, in 10 ms
+#define SYNC_SCHED_MAX_TIMEOUT        0x4000
+#define SYNC_SCHED_RETUNE_SLICES      10    // Slices before a sync is reopened to lower its rate
+#define SYNC_SCHED_DEFAULT_IQ_BUDGET  0     // IQ reports per second of all tags, 0 for no limit
+
+// Eviction when a new tag is found with all SYNC_SCHED_MAX_TAGS entries in use
+#define SYNC_SCHED_DEFAULT_EVICTION   SYNC_EVICT_STALEST
+#define SYNC_SCHED_EVICT_RSSI_MARGIN  3     // dB a new tag must be stronger than the weakest one
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef enum {
+  SYNC_STATE_IDLE = 0,      // Known, waiting for a sync
+  SYNC_STATE_OPENING,       // sl_bt_sync_open() called, waiting for the sync to be established
+  SYNC_STATE_SYNCED,        // Receiving periodic advertisements and CTEs
+  SYNC_STATE_CLOSING,       // sl_bt_sync_close() called, waiting for the sync closed event
+  SYNC_STATE_FREE,          // Entry not in use
+  SYNC_STATE_BACKOFF        // Sync failed, waiting to retry
+} sync_state_t;
+
+// Entry given up for a new tag when all are in use. A new tag is only admitted if it beats the
+// victim, so that no sync is opened just to be evicted again.
+typedef enum {
+  SYNC_EVICT_STALEST = 0,         // Tag not seen for longest, once past SYNC_SCHED_SEEN_TIMEOUT_MS
+  SYNC_EVICT_WEAKEST_RSSI,        // Weakest tag, if the new one is stronger by the margin
+  SYNC_EVICT_LOWEST_PRIORITY      // Lowest priority below the default, else the stalest
+} sync_eviction_t;
+
+// Known tag, kept while it is not synchronized to resync without a new discovery
+typedef struct {
+  bd_addr address;
+  uint8_t address_type;
+  uint8_t adv_sid;
+  uint8_t state;            // sync_state_t
+  uint8_t priority;
+  uint8_t motion;           // Smoothed angle change in degrees per slice
+  int8_t rssi;              // Smoothed RSSI of the scan reports
+  uint8_t failures;         // Failed syncs in a row
+  bool retry;               // Sync failed, backoff when it is closed
+  bool resync;              // Sync lost, being reopened directly with the known SID
+  bool reopen;              // Sync closed to be reopened with another skip
+  bool motion_valid;        // Angles estimated on the locator, the motion is known
+  uint16_t skip;            // Periodic advertisements skipped by the current sync
+  uint16_t iq_reports;      // Since the last $RATE line
+  bool evict;               // Entry is freed when the sync closes
+  bool cached;              // Restored from the tag cache at boot, not discovered by scanning
+  bool iq_received;         // First IQ report since reset reported
+  uint16_t sync_handle;
+  uint16_t adv_interval;    // Periodic advertising interval of the last sync, in 1.25 ms
+  uint8_t adv_phy;          // PHY of the periodic train of the last sync
+  uint16_t slices;          // Slices spent in the current state
+  uint32_t pass;            // Stride scheduling position, lowest pass gets synced next
+  uint32_t last_seen_tick;  // Sleeptimer tick of the last scan report
+  uint32_t lost_tick;       // Sleeptimer tick of the sync loss, while resyncing
+  float azimuth;            // Angles at the previous slice, for the motion estimate
+  float elevation;
+  timer_wheel_timer_t timer;  // Open timeout while opening, backoff, inactivity timeout otherwise
+} sync_tag_t;
+
+typedef struct {
+  bd_addr address;
+  uint8_t address_type;
+  uint8_t adv_sid;
+  uint16_t adv_interval;
+} sync_cache_entry_t;
+
+// NVM3 object of the tag cache
+typedef struct {
+  uint8_t count;
+  sync_cache_entry_t entries[SYNC_SCHED_CACHE_SIZE];
+} sync_cache_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void sync_sched_init(void);
+
+// Open the syncs of the cached tags, once the scanner is running
+void sync_sched_start(void);
+
+sync_tag_t* sync_sched_seen(const bd_addr *address, uint8_t address_type, int8_t rssi);
+
+sync_tag_t* sync_sched_add(const bd_addr *address, uint8_t address_type, uint8_t adv_sid, int8_t rssi);
+
+// NULL if the sync is not wanted anymore and is to be closed
+sync_tag_t* sync_sched_opened(uint16_t sync, uint16_t adv_interval, uint8_t adv_phy);
+
+void sync_sched_closed(uint16_t sync);
+
+// Drop the known tags no longer accepted after a change of the allow or deny list
+void sync_sched_filter_changed(void);
+
+// Longest periodic advertising interval of the known tags waiting for a sync, in 1.25 ms. The
+// scanner alone keeps them alive. 0 if no tag is waiting.
+uint16_t sync_sched_get_waiting_interval(void);
+
+// Syncs being established, and all syncs in use including those
+void sync_sched_get_syncs(uint8_t *opening, uint8_t *in_use);
+
+// CTE report of the sync, keeps the tag alive
+void sync_sched_iq_received(uint16_t sync);
+
+/** @} (end addtogroup app) */
+/** @} (end addtogroup Application) */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* SYNC_SCHED_H */
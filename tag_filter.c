@@ -0,0 +1,255 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Tag allow and deny lists. Scan reports of unwanted advertisers are dropped before their
+ *         payload is parsed, optionally already in the controller.
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nvm3_default.h"
+#include "sl_iostream.h"
+#include "conn.h"
+#include "cmd.h"
+#include "aoa_cfg.h"
+#include "sync_sched.h"
+#include "scan_policy.h"
+#include "tag_filter.h"
+
+#define INDEX_EMPTY 0xFF
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+static tag_filter_entries_t lists[TAG_FILTER_LIST_COUNT];
+
+static const nvm3_ObjectKey_t list_keys[TAG_FILTER_LIST_COUNT] = {
+  AOA_CFG_NVM3_KEY_ALLOW_LIST,
+  AOA_CFG_NVM3_KEY_DENY_LIST
+};
+
+static const char *list_names[TAG_FILTER_LIST_COUNT] = { "ALLOW", "DENY" };
+
+// Entries of both lists by address hash, linear probing. Holds list * TAG_FILTER_MAX_ENTRIES + entry.
+static uint8_t filter_index[TAG_FILTER_INDEX_SIZE];
+
+#if TAG_FILTER_CONTROLLER_OFFLOAD
+// All allowed tags made it into the controller's accept list
+static bool offloaded;
+#endif
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static int8_t find_list(const bd_addr *address, uint8_t *entry);
+static void build_index(void);
+static void remove_entry(tag_filter_list_t list, uint8_t entry);
+#if TAG_FILTER_CONTROLLER_OFFLOAD
+static void offload_entry(const tag_filter_entry_t *entry);
+static void apply_whitelisting(void);
+#endif
+static sl_status_t list_cmd(uint8_t argc, char *argv[]);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+void tag_filter_init(void)
+{
+  for (uint8_t list = 0; list < TAG_FILTER_LIST_COUNT; list++) {
+    if (nvm3_readData(nvm3_defaultHandle, list_keys[list], &lists[list], sizeof(lists[list])) != ECODE_NVM3_OK
+        || lists[list].count > TAG_FILTER_MAX_ENTRIES) {
+      memset(&lists[list], 0, sizeof(lists[list]));
+    }
+  }
+  build_index();
+
+  cmd_register("ALLOW", list_cmd);
+  cmd_register("DENY", list_cmd);
+}
+
+void tag_filter_start(void)
+{
+#if TAG_FILTER_CONTROLLER_OFFLOAD
+  offloaded = true;
+  for (uint8_t i = 0; i < lists[TAG_FILTER_ALLOW].count; i++) {
+    offload_entry(&lists[TAG_FILTER_ALLOW].entries[i]);
+  }
+  apply_whitelisting();
+#endif
+}
+
+bool tag_filter_accept(const bd_addr *address)
+{
+  int8_t list;
+  uint8_t entry;
+
+  if (lists[TAG_FILTER_ALLOW].count == 0 && lists[TAG_FILTER_DENY].count == 0) {
+    return true;
+  }
+
+  list = find_list(address, &entry);
+  if (list == TAG_FILTER_DENY
+      || (lists[TAG_FILTER_ALLOW].count > 0 && list != TAG_FILTER_ALLOW)) {
+    return false;
+  }
+  return true;
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// List holding the address, -1 if none
+static int8_t find_list(const bd_addr *address, uint8_t *entry)
+{
+  uint32_t bucket = conn_address_hash(address, 0) & (TAG_FILTER_INDEX_SIZE - 1);
+  uint8_t value;
+  uint8_t list;
+
+  while ((value = filter_index[bucket]) != INDEX_EMPTY) {
+    list = value / TAG_FILTER_MAX_ENTRIES;
+    *entry = value % TAG_FILTER_MAX_ENTRIES;
+    if (0 == memcmp(address, &lists[list].entries[*entry].address, sizeof(bd_addr))) {
+      return (int8_t)list;
+    }
+    bucket = (bucket + 1) & (TAG_FILTER_INDEX_SIZE - 1);
+  }
+  return -1;
+}
+
+// The lists change rarely, the index is simply rebuilt
+static void build_index(void)
+{
+  uint32_t bucket;
+
+  memset(filter_index, INDEX_EMPTY, sizeof(filter_index));
+  for (uint8_t list = 0; list < TAG_FILTER_LIST_COUNT; list++) {
+    for (uint8_t i = 0; i < lists[list].count; i++) {
+      bucket = conn_address_hash(&lists[list].entries[i].address, 0) & (TAG_FILTER_INDEX_SIZE - 1);
+      while (filter_index[bucket] != INDEX_EMPTY) {
+        bucket = (bucket + 1) & (TAG_FILTER_INDEX_SIZE - 1);
+      }
+      filter_index[bucket] = list * TAG_FILTER_MAX_ENTRIES + i;
+    }
+  }
+}
+
+static void remove_entry(tag_filter_list_t list, uint8_t entry)
+{
+  lists[list].count--;
+  lists[list].entries[entry] = lists[list].entries[lists[list].count];
+}
+
+#if TAG_FILTER_CONTROLLER_OFFLOAD
+static void offload_entry(const tag_filter_entry_t *entry)
+{
+  if (offloaded && sl_bt_sm_add_to_whitelist(entry->address, entry->address_type) != SL_STATUS_OK) {
+    // Accept list full, the filtering is left to the software check
+    offloaded = false;
+  }
+}
+
+// Whitelisting is off while the allow list is empty. A running scanner only takes the change when
+// it is started again.
+static void apply_whitelisting(void)
+{
+  sl_bt_gap_enable_whitelisting(offloaded && lists[TAG_FILTER_ALLOW].count > 0);
+  scan_policy_restart();
+}
+#endif
+
+// $ALLOW                                  list the allowed tags
+// $ALLOW,CLEAR                            accept all tags not denied
+// $ALLOW,ADD,<tag id>[,<address type>]    address type for the controller, public by default
+// $ALLOW,DEL,<tag id>
+// $DENY with the same arguments for the denied tags. A tag is only in one of the lists.
+static sl_status_t list_cmd(uint8_t argc, char *argv[])
+{
+  char str[48];
+  tag_filter_list_t list = (strcmp(argv[0], "DENY") == 0) ? TAG_FILTER_DENY : TAG_FILTER_ALLOW;
+  tag_filter_entry_t new_entry;
+  uint64_t id;
+  long address_type = 0;
+  char *end;
+  int8_t found;
+  uint8_t entry;
+
+  if (argc == 1) {
+    for (uint8_t i = 0; i < lists[list].count; i++) {
+      sprintf(str, "$%s,%llu,%u\n",
+              list_names[list],
+              conn_address_to_id(&lists[list].entries[i].address),
+              lists[list].entries[i].address_type);
+      sl_iostream_write(SL_IOSTREAM_STDOUT, str, strlen(str));
+    }
+    return SL_STATUS_OK;
+  }
+
+  if (argc == 2 && strcmp(argv[1], "CLEAR") == 0) {
+    lists[list].count = 0;
+  } else if ((argc == 3 || argc == 4) && (strcmp(argv[1], "ADD") == 0 || strcmp(argv[1], "DEL") == 0)) {
+    id = strtoull(argv[2], &end, 10);
+    if (end == argv[2] || *end != '\0') {
+      return SL_STATUS_INVALID_PARAMETER;
+    }
+    if (argc == 4) {
+      address_type = strtol(argv[3], &end, 10);
+      if (end == argv[3] || *end != '\0' || address_type < 0 || address_type > 3) {
+        return SL_STATUS_INVALID_PARAMETER;
+      }
+    }
+    memset(&new_entry, 0, sizeof(new_entry));
+    conn_id_to_address(id, &new_entry.address);
+    new_entry.address_type = (uint8_t)address_type;
+
+    found = find_list(&new_entry.address, &entry);
+    if (strcmp(argv[1], "DEL") == 0) {
+      if (found != (int8_t)list) {
+        return SL_STATUS_NOT_FOUND;
+      }
+      remove_entry(list, entry);
+    } else {
+      if (found == (int8_t)list) {
+        lists[list].entries[entry] = new_entry;
+      } else {
+        if (lists[list].count >= TAG_FILTER_MAX_ENTRIES) {
+          return SL_STATUS_FULL;
+        }
+        if (found >= 0) {
+          remove_entry((tag_filter_list_t)found, entry);
+          nvm3_writeData(nvm3_defaultHandle, list_keys[found], &lists[found], sizeof(lists[found]));
+        }
+        lists[list].entries[lists[list].count++] = new_entry;
+      }
+#if TAG_FILTER_CONTROLLER_OFFLOAD
+      if (list == TAG_FILTER_ALLOW) {
+        offload_entry(&new_entry);
+      }
+#endif
+    }
+  } else {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
+
+  build_index();
+  sync_sched_filter_changed();
+#if TAG_FILTER_CONTROLLER_OFFLOAD
+  // Also after a DEL or a move to the deny list emptied the allow list
+  apply_whitelisting();
+#endif
+
+  if (nvm3_writeData(nvm3_defaultHandle, list_keys[list], &lists[list], sizeof(lists[list])) != ECODE_NVM3_OK) {
+    return SL_STATUS_FAIL;
+  }
+  return SL_STATUS_OK;
+}
@@ -0,0 +1,85 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Tag allow and deny lists header file
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef TAG_FILTER_H
+#define TAG_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sl_bt_api.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************************************//**
+ * @addtogroup Application
+ * @{
+ **************************************************************************************************/
+
+/***********************************************************************************************//**
+ * @addtogroup app
+ * @{
+ **************************************************************************************************/
+
+#define TAG_FILTER_MAX_ENTRIES        32    // Per list
+#define TAG_FILTER_INDEX_SIZE         128   // Power of two, at least twice the entries of both lists
+
+// Also load the allow list into the controller's filter accept list, so that advertisements of
+// other devices do not reach the host at all. Off by default: the accept list is shared with the
+// bonded devices and entries can only be added at runtime, removals take effect after a reset.
+#ifndef TAG_FILTER_CONTROLLER_OFFLOAD
+#define TAG_FILTER_CONTROLLER_OFFLOAD 0
+#endif
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef enum {
+  TAG_FILTER_ALLOW = 0,   // If not empty, only these tags are accepted
+  TAG_FILTER_DENY,        // These tags are never accepted
+  TAG_FILTER_LIST_COUNT
+} tag_filter_list_t;
+
+typedef struct {
+  bd_addr address;
+  uint8_t address_type;   // Only used by the controller, the software check matches the address
+} tag_filter_entry_t;
+
+// NVM3 object of one list
+typedef struct {
+  uint8_t count;
+  tag_filter_entry_t entries[TAG_FILTER_MAX_ENTRIES];
+} tag_filter_entries_t;
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void tag_filter_init(void);
+
+// Load the allow list into the controller, after the boot event
+void tag_filter_start(void);
+
+// Scan report fast path, checked before the advertisement payload is parsed
+bool tag_filter_accept(const bd_addr *address);
+
+/** @} (end addtogroup app) */
+/** @} (end addtogroup Application) */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* TAG_FILTER_H */
@@ -0,0 +1,116 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Reference advertising data parsers the parser under test is compared with
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef AD_REFERENCE_H
+#define AD_REFERENCE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "ad_parser.h"
+
+#define REFERENCE_UUID128_LEN 16
+
+// The service UUID search of the application before ad_parser. It trusts the length bytes, so it
+// is only given well formed advertising data.
+static inline uint8_t reference_find_service(const uint8_t *advdata,
+                                             uint8_t advlen,
+                                             const uint8_t *service_uuid)
+{
+  uint8_t ad_field_length;
+  uint8_t ad_field_type;
+  const uint8_t *ad_uuid_field;
+  uint32_t i = 0;
+  uint32_t next_ad_structure;
+
+  while (i < advlen) {
+    ad_field_length = advdata[i];
+    ad_field_type = advdata[i + 1];
+    next_ad_structure = i + ad_field_length + 1;
+    if (ad_field_type == AD_TYPE_UUID128_INCOMPLETE || ad_field_type == AD_TYPE_UUID128_COMPLETE) {
+      for (ad_uuid_field = advdata + i + 2;
+           ad_uuid_field < advdata + next_ad_structure;
+           ad_uuid_field += REFERENCE_UUID128_LEN) {
+        if (memcmp(ad_uuid_field, service_uuid, REFERENCE_UUID128_LEN) == 0) {
+          return 1;
+        }
+      }
+    }
+    i = next_ad_structure;
+  }
+  return 0;
+}
+
+// Whether the value of an AD structure holds the pattern, one AD type at a time
+static inline bool reference_value_match(uint8_t type,
+                                         const uint8_t *value,
+                                         uint8_t value_len,
+                                         const ad_pattern_t *pattern)
+{
+  switch (pattern->kind) {
+    case AD_PATTERN_SERVICE_UUID:
+      // Complete and incomplete lists
+      if (!((pattern->len == 2 && (type | 1) == AD_TYPE_UUID16_COMPLETE)
+            || (pattern->len == 4 && (type | 1) == AD_TYPE_UUID32_COMPLETE)
+            || (pattern->len == 16 && (type | 1) == AD_TYPE_UUID128_COMPLETE))) {
+        return false;
+      }
+      for (uint8_t i = 0; i + pattern->len <= value_len; i += pattern->len) {
+        if (memcmp(&value[i], pattern->value, pattern->len) == 0) {
+          return true;
+        }
+      }
+      return false;
+
+    case AD_PATTERN_SERVICE_DATA:
+      if (!((pattern->len == 2 && type == AD_TYPE_SERVICE_DATA_UUID16)
+            || (pattern->len == 4 && type == AD_TYPE_SERVICE_DATA_UUID32)
+            || (pattern->len == 16 && type == AD_TYPE_SERVICE_DATA_UUID128))) {
+        return false;
+      }
+      return value_len >= pattern->len && memcmp(value, pattern->value, pattern->len) == 0;
+
+    case AD_PATTERN_MANUFACTURER:
+      return pattern->len == 2 && type == AD_TYPE_MANUFACTURER_DATA
+             && value_len >= 2 && memcmp(value, pattern->value, 2) == 0;
+
+    default:
+      return false;
+  }
+}
+
+// ad_parser_match() as documented, byte by byte: parsing stops at a zero length or at a structure
+// running past the end
+static inline uint32_t reference_match(const uint8_t *data,
+                                       uint8_t len,
+                                       const ad_pattern_t *patterns,
+                                       uint8_t count)
+{
+  uint32_t found = 0;
+  uint16_t i = 0;
+
+  while (i + 2 <= len) {
+    if (data[i] == 0 || i + 1 + data[i] > len) {
+      break;
+    }
+    for (uint8_t n = 0; n < count; n++) {
+      if (reference_value_match(data[i + 1], &data[i + 2], data[i] - 1, &patterns[n])) {
+        found |= 1UL << n;
+      }
+    }
+    i += 1 + data[i];
+  }
+  return found;
+}
+
+#endif // AD_REFERENCE_H
@@ -0,0 +1,159 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host benchmark of the advertising data parser against the service UUID search it replaced
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <string.h>
+#include "ad_parser.h"
+#include "ad_reference.h"
+#include "host_test.h"
+
+#define ROUNDS        15
+#define REPORTS       4096
+#define PASSES        500
+#define MAX_ADV_LEN   64
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+static const ad_pattern_t patterns[] = {
+  { AD_PATTERN_SERVICE_UUID, 16, { 0x50, 0x69, 0x96, 0x81, 0xb7, 0xa8, 0xad, 0x07, 0x96, 0xf2, 0x3f, 0x07, 0x64, 0x36, 0xd0, 0x0e } },
+  { AD_PATTERN_SERVICE_UUID, 2, { 0x0f, 0x18 } },
+  { AD_PATTERN_SERVICE_DATA, 2, { 0xaa, 0xfe } },
+  { AD_PATTERN_MANUFACTURER, 2, { 0x4c, 0x00 } },
+};
+
+static uint8_t reports[REPORTS][MAX_ADV_LEN];
+static uint8_t report_lens[REPORTS];
+
+static ad_pattern_set_t cte_set;
+static ad_pattern_set_t all_set;
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// Typical scan reports: flags, then beacons' manufacturer data, 16-bit UUID lists with a name, or
+// 128-bit UUID lists. One in ten is a tag.
+static void make_reports(void)
+{
+  uint8_t *data;
+  uint8_t n;
+
+  for (uint32_t i = 0; i < REPORTS; i++) {
+    data = reports[i];
+    n = 0;
+    data[n++] = 2;
+    data[n++] = 0x01;
+    data[n++] = 0x06;
+    switch (host_test_random() % 4) {
+      case 0:
+        data[n++] = 26;
+        data[n++] = AD_TYPE_MANUFACTURER_DATA;
+        for (uint8_t b = 0; b < 25; b++) {
+          data[n++] = (uint8_t)host_test_random();
+        }
+        break;
+
+      case 1:
+        data[n++] = 5;
+        data[n++] = AD_TYPE_UUID16_COMPLETE;
+        for (uint8_t b = 0; b < 4; b++) {
+          data[n++] = (uint8_t)host_test_random();
+        }
+        data[n++] = 9;
+        data[n++] = 0x09;
+        for (uint8_t b = 0; b < 8; b++) {
+          data[n++] = (uint8_t)('a' + b);
+        }
+        break;
+
+      case 2:
+        data[n++] = 17;
+        data[n++] = AD_TYPE_UUID128_COMPLETE;
+        for (uint8_t b = 0; b < 16; b++) {
+          data[n++] = (i % 10 == 0) ? patterns[0].value[b] : (uint8_t)host_test_random();
+        }
+        break;
+
+      default:
+        data[n++] = 17;
+        data[n++] = AD_TYPE_UUID128_INCOMPLETE;
+        for (uint8_t b = 0; b < 16; b++) {
+          data[n++] = (uint8_t)host_test_random();
+        }
+        data[n++] = 3;
+        data[n++] = AD_TYPE_SERVICE_DATA_UUID16;
+        data[n++] = (uint8_t)host_test_random();
+        data[n++] = (uint8_t)host_test_random();
+        break;
+    }
+    report_lens[i] = n;
+  }
+}
+
+// Fastest of several rounds, in ns per report
+static double search_ns(void)
+{
+  volatile uint32_t sink = 0;
+  double best = 1e30;
+  double start;
+  double ns;
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    start = host_test_now_ns();
+    for (uint32_t pass = 0; pass < PASSES; pass++) {
+      for (uint32_t i = 0; i < REPORTS; i++) {
+        sink += reference_find_service(reports[i], report_lens[i], patterns[0].value);
+      }
+    }
+    ns = (host_test_now_ns() - start) / (PASSES * REPORTS);
+    if (ns < best) {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+static double match_ns(const ad_pattern_set_t *set)
+{
+  volatile uint32_t sink = 0;
+  double best = 1e30;
+  double start;
+  double ns;
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    start = host_test_now_ns();
+    for (uint32_t pass = 0; pass < PASSES; pass++) {
+      for (uint32_t i = 0; i < REPORTS; i++) {
+        sink += ad_parser_match(reports[i], report_lens[i], set);
+      }
+    }
+    ns = (host_test_now_ns() - start) / (PASSES * REPORTS);
+    if (ns < best) {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+int main(void)
+{
+  ad_parser_set_init(&cte_set, patterns, 1);
+  ad_parser_set_init(&all_set, patterns, sizeof(patterns) / sizeof(patterns[0]));
+  make_reports();
+
+  printf("service UUID search, as before: %.1f ns per report\n", search_ns());
+  printf("parser, CTE service:            %.1f ns per report\n", match_ns(&cte_set));
+  printf("parser, 4 patterns:             %.1f ns per report\n", match_ns(&all_set));
+  return 0;
+}
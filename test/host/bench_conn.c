@@ -0,0 +1,167 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host benchmark of the tag table lookups, by handle and by address
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <string.h>
+#include "conn.h"
+#include "host_test.h"
+
+#define ROUNDS            15
+#define LOOKUPS           (1000 * 1000)
+
+#define STORM_ADVERTISERS 500
+#define STORM_REPORTS     (1000 * 1000)
+
+void aoa_tag_init(aoa_tag_state_t *tag_state, aoa_channel_group_t *group)
+{
+  (void)tag_state;
+  (void)group;
+}
+
+void aoa_tag_deinit(aoa_tag_state_t *tag_state)
+{
+  (void)tag_state;
+}
+
+// Fastest of several rounds, in ns per call
+static double lookup_ns(const uint16_t *handles)
+{
+  volatile uintptr_t sink = 0;
+  double best = 1e30;
+  double start;
+  double ns;
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    start = host_test_now_ns();
+    for (uint32_t i = 0; i < LOOKUPS; i++) {
+      sink += (uintptr_t)get_connection_by_handle(handles[i % AOA_MAX_TAGS]);
+    }
+    ns = (host_test_now_ns() - start) / LOOKUPS;
+    if (ns < best) {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+// Per IQ report lookup by handle. Handles of the stack are small and go through the direct map,
+// larger ones through the linear scan that the table used for every lookup before.
+static void bench_handle_lookup(void)
+{
+  uint16_t mapped[AOA_MAX_TAGS];
+  uint16_t scanned[AOA_MAX_TAGS];
+  bd_addr address;
+  double start;
+  double churn;
+
+  memset(&address, 0, sizeof(address));
+  init_connection();
+  for (uint8_t i = 0; i < AOA_MAX_TAGS; i++) {
+    mapped[i] = i;
+    address.addr[0] = i;
+    add_connection(mapped[i], &address, 0, 0);
+  }
+  printf("handle lookup, direct map:   %.1f ns\n", lookup_ns(mapped));
+
+  init_connection();
+  for (uint8_t i = 0; i < AOA_MAX_TAGS; i++) {
+    scanned[i] = CONN_HANDLE_MAP_SIZE + i;
+    address.addr[0] = i;
+    add_connection(scanned[i], &address, 0, 0);
+  }
+  printf("handle lookup, linear scan:  %.1f ns\n", lookup_ns(scanned));
+
+  // A tag leaving and another taking its slot, the other entries stay where they are
+  init_connection();
+  for (uint8_t i = 0; i < AOA_MAX_TAGS; i++) {
+    address.addr[0] = i;
+    add_connection(i, &address, 0, 0);
+  }
+  start = host_test_now_ns();
+  for (uint32_t i = 0; i < LOOKUPS; i++) {
+    remove_connection((uint16_t)(i % AOA_MAX_TAGS));
+    address.addr[0] = (uint8_t)i;
+    add_connection((uint16_t)(i % AOA_MAX_TAGS), &address, 0, 0);
+  }
+  churn = (host_test_now_ns() - start) / LOOKUPS;
+  printf("remove and add:              %.1f ns\n", churn);
+}
+
+// Lookup by scanning the whole table, as before the address index
+static conn_properties_t* scan_by_address(const bd_addr *address, uint8_t address_type)
+{
+  conn_properties_t *tag;
+
+  for (uint8_t i = 0; i < AOA_MAX_TAGS; i++) {
+    tag = get_connection_by_index(i);
+    if (tag != NULL && tag->address_type == address_type
+        && memcmp(address, &tag->address, sizeof(bd_addr)) == 0) {
+      return tag;
+    }
+  }
+  return NULL;
+}
+
+// Scan storm: reports of hundreds of advertisers, a few of them the known tags. Every report is
+// looked up by address before its payload would be parsed.
+static void bench_scan_storm(void)
+{
+  static bd_addr advertisers[STORM_ADVERTISERS];
+  static uint16_t reports[STORM_REPORTS];
+  volatile uintptr_t sink = 0;
+  double best_index = 1e30;
+  double best_scan = 1e30;
+  double start;
+  double ns;
+
+  for (uint32_t i = 0; i < STORM_ADVERTISERS; i++) {
+    for (uint8_t b = 0; b < sizeof(advertisers[i].addr); b++) {
+      advertisers[i].addr[b] = (uint8_t)host_test_random();
+    }
+  }
+  for (uint32_t i = 0; i < STORM_REPORTS; i++) {
+    reports[i] = (uint16_t)(host_test_random() % STORM_ADVERTISERS);
+  }
+  init_connection();
+  for (uint8_t i = 0; i < AOA_MAX_TAGS; i++) {
+    add_connection(i, &advertisers[i * (STORM_ADVERTISERS / AOA_MAX_TAGS)], 0, 0);
+  }
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    start = host_test_now_ns();
+    for (uint32_t i = 0; i < STORM_REPORTS; i++) {
+      sink += (uintptr_t)get_connection_by_address(&advertisers[reports[i]], 0);
+    }
+    ns = (host_test_now_ns() - start) / STORM_REPORTS;
+    if (ns < best_index) {
+      best_index = ns;
+    }
+
+    start = host_test_now_ns();
+    for (uint32_t i = 0; i < STORM_REPORTS; i++) {
+      sink += (uintptr_t)scan_by_address(&advertisers[reports[i]], 0);
+    }
+    ns = (host_test_now_ns() - start) / STORM_REPORTS;
+    if (ns < best_scan) {
+      best_scan = ns;
+    }
+  }
+  printf("scan storm of %u advertisers, address index: %.1f ns\n", STORM_ADVERTISERS, best_index);
+  printf("scan storm of %u advertisers, table scan:    %.1f ns\n", STORM_ADVERTISERS, best_scan);
+}
+
+int main(void)
+{
+  bench_handle_lookup();
+  bench_scan_storm();
+  return 0;
+}
@@ -0,0 +1,306 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host benchmark of the scan report fast path: scan traffic replayed through the tag filter,
+ *         the advertising data parser and the sync scheduler, in either order of the last stages
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <string.h>
+#include "ad_parser.h"
+#include "sync_sched.h"
+#include "timer_wheel.h"
+#include "tag_filter.h"
+#include "conn.h"
+#include "cmd.h"
+#include "scan_policy.h"
+#include "sched.h"
+#include "sdk_stubs.h"
+#include "host_test.h"
+
+#define ROUNDS          15
+#define REPORTS         8192
+#define PASSES          100
+#define MAX_ADV_LEN     191
+
+typedef struct {
+  bd_addr address;
+  uint8_t packet_type;
+  uint8_t len;
+  uint8_t data[MAX_ADV_LEN];
+} replay_report_t;
+
+typedef struct {
+  const char *name;
+  uint16_t advertisers;
+  uint16_t tags;          // The first advertisers
+  uint8_t legacy_percent; // Of the reports of the other advertisers
+} scenario_t;
+
+// Stage that ended the handling of a report, as counted by the application in $SCAN
+typedef enum {
+  STAGE_NOT_EXTENDED = 0,
+  STAGE_FILTERED,
+  STAGE_KNOWN,
+  STAGE_NO_SERVICE,
+  STAGE_NEW_TAG,
+  STAGE_COUNT
+} stage_t;
+
+typedef stage_t (*handler_t)(const replay_report_t *report);
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+// The tag patterns of the application
+static const ad_pattern_t tag_patterns[] = {
+  { AD_PATTERN_SERVICE_UUID, 16, { 0x50, 0x69, 0x96, 0x81, 0xb7, 0xa8, 0xad, 0x07, 0x96, 0xf2, 0x3f, 0x07, 0x64, 0x36, 0xd0, 0x0e } },
+};
+
+static const scenario_t scenarios[] = {
+  { "busy site, 600 advertisers, 20 tags", 600, 20, 25 },
+  { "dense tags, 64 advertisers, 32 tags", 64, 32, 25 },
+  { "crowd, 2000 advertisers, 8 tags", 2000, 8, 50 },
+};
+
+static ad_pattern_set_t tag_pattern_set;
+static replay_report_t reports[REPORTS];
+static uint32_t stage_counts[STAGE_COUNT];
+
+/***************************************************************************************************
+ * Application modules around the scheduler
+ **************************************************************************************************/
+void aoa_tag_init(aoa_tag_state_t *tag_state, aoa_channel_group_t *group)
+{
+  (void)tag_state;
+  (void)group;
+}
+
+void aoa_tag_deinit(aoa_tag_state_t *tag_state)
+{
+  (void)tag_state;
+}
+
+void scan_policy_update(void)
+{
+}
+
+void scan_policy_resync_failed(void)
+{
+}
+
+void scan_policy_restart(void)
+{
+}
+
+void sched_set_weight(conn_properties_t *tag, uint8_t weight)
+{
+  (void)tag;
+  (void)weight;
+}
+
+sl_status_t cmd_register(const char *name, cmd_handler_t handler)
+{
+  (void)name;
+  (void)handler;
+  return SL_STATUS_OK;
+}
+
+/***************************************************************************************************
+ * Scan report handlers
+ **************************************************************************************************/
+
+// The order of the application before: known tags looked up ahead of the parse
+static stage_t seen_first(const replay_report_t *report)
+{
+  if (!(report->packet_type & 0x80)) {
+    return STAGE_NOT_EXTENDED;
+  }
+  if (!tag_filter_accept(&report->address)) {
+    return STAGE_FILTERED;
+  }
+  if (sync_sched_seen(&report->address, 0, -60) != NULL) {
+    return STAGE_KNOWN;
+  }
+  if (ad_parser_match(report->data, report->len, &tag_pattern_set) == 0) {
+    return STAGE_NO_SERVICE;
+  }
+  return (sync_sched_add(&report->address, 0, 1, -60) != NULL) ? STAGE_NEW_TAG : STAGE_NO_SERVICE;
+}
+
+// The order of handle_scan_report() in app.c: only reports of tags are looked up
+static stage_t parse_first(const replay_report_t *report)
+{
+  if (!(report->packet_type & 0x80)) {
+    return STAGE_NOT_EXTENDED;
+  }
+  if (!tag_filter_accept(&report->address)) {
+    return STAGE_FILTERED;
+  }
+  if (ad_parser_match(report->data, report->len, &tag_pattern_set) == 0) {
+    return STAGE_NO_SERVICE;
+  }
+  if (sync_sched_seen(&report->address, 0, -60) != NULL) {
+    return STAGE_KNOWN;
+  }
+  return (sync_sched_add(&report->address, 0, 1, -60) != NULL) ? STAGE_NEW_TAG : STAGE_NO_SERVICE;
+}
+
+/***************************************************************************************************
+ * Traffic
+ **************************************************************************************************/
+
+static uint8_t add_random(uint8_t *data, uint8_t n, uint8_t count)
+{
+  for (uint8_t i = 0; i < count; i++) {
+    data[n++] = (uint8_t)host_test_random();
+  }
+  return n;
+}
+
+// Tags: flags and the CTE service. Others: flags, then manufacturer data, a 16-bit UUID list with a
+// name, or a foreign 128-bit UUID list, some with a longer extended advertising payload.
+static void make_report(replay_report_t *report, uint16_t advertiser, const scenario_t *scenario)
+{
+  uint8_t *data = report->data;
+  uint8_t n = 0;
+
+  memset(&report->address, 0, sizeof(report->address));
+  report->address.addr[0] = (uint8_t)advertiser;
+  report->address.addr[1] = (uint8_t)(advertiser >> 8);
+  report->address.addr[5] = 0xC0;
+  report->packet_type = 0x80;
+
+  data[n++] = 2;
+  data[n++] = 0x01;
+  data[n++] = 0x06;
+  if (advertiser < scenario->tags) {
+    data[n++] = 17;
+    data[n++] = AD_TYPE_UUID128_COMPLETE;
+    memcpy(&data[n], tag_patterns[0].value, 16);
+    report->len = n + 16;
+    return;
+  }
+
+  if (host_test_random() % 100 < scenario->legacy_percent) {
+    report->packet_type = 0x00;
+  }
+  // Each advertiser keeps its kind of payload
+  switch (advertiser % 4) {
+    case 0:
+      data[n++] = 26;
+      data[n++] = AD_TYPE_MANUFACTURER_DATA;
+      n = add_random(data, n, 25);
+      break;
+
+    case 1:
+      data[n++] = 5;
+      data[n++] = AD_TYPE_UUID16_COMPLETE;
+      n = add_random(data, n, 4);
+      data[n++] = 9;
+      data[n++] = 0x09;
+      n = add_random(data, n, 8);
+      break;
+
+    case 2:
+      data[n++] = 17;
+      data[n++] = AD_TYPE_UUID128_COMPLETE;
+      n = add_random(data, n, 16);
+      break;
+
+    default:
+      for (uint8_t i = 0; i < 5; i++) {
+        data[n++] = 31;
+        data[n++] = AD_TYPE_MANUFACTURER_DATA;
+        n = add_random(data, n, 30);
+      }
+      break;
+  }
+  report->len = n;
+}
+
+static void make_traffic(const scenario_t *scenario)
+{
+  for (uint32_t i = 0; i < REPORTS; i++) {
+    make_report(&reports[i], (uint16_t)(host_test_random() % scenario->advertisers), scenario);
+  }
+}
+
+/***************************************************************************************************
+ * Benchmark
+ **************************************************************************************************/
+
+// Fastest of several rounds in ns per report, once all the tags are known. The time stands still,
+// no tag times out.
+static double replay_ns(handler_t handler)
+{
+  volatile uint32_t sink = 0;
+  double best = 1e30;
+  double start;
+  double ns;
+
+  sdk_stubs_reset();
+  timer_wheel_init();
+  sync_sched_init();
+  sync_sched_start();
+
+  memset(stage_counts, 0, sizeof(stage_counts));
+  for (uint32_t i = 0; i < REPORTS; i++) {
+    handler(&reports[i]);
+  }
+  for (uint32_t i = 0; i < REPORTS; i++) {
+    stage_counts[handler(&reports[i])]++;
+  }
+
+  for (uint32_t round = 0; round < ROUNDS; round++) {
+    start = host_test_now_ns();
+    for (uint32_t pass = 0; pass < PASSES; pass++) {
+      for (uint32_t i = 0; i < REPORTS; i++) {
+        sink += handler(&reports[i]);
+      }
+    }
+    ns = (host_test_now_ns() - start) / (PASSES * REPORTS);
+    if (ns < best) {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+int main(void)
+{
+  uint32_t seen_counts[STAGE_COUNT];
+  double seen_ns;
+  double parse_ns;
+
+  ad_parser_set_init(&tag_pattern_set, tag_patterns, sizeof(tag_patterns) / sizeof(tag_patterns[0]));
+  tag_filter_init();
+
+  for (uint8_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+    make_traffic(&scenarios[s]);
+    seen_ns = replay_ns(seen_first);
+    memcpy(seen_counts, stage_counts, sizeof(seen_counts));
+    parse_ns = replay_ns(parse_first);
+
+    // Both orders end the handling of each report at the same stage
+    CHECK(stage_counts[STAGE_NOT_EXTENDED] == seen_counts[STAGE_NOT_EXTENDED]);
+    CHECK(stage_counts[STAGE_KNOWN] == seen_counts[STAGE_KNOWN]);
+    CHECK(stage_counts[STAGE_NO_SERVICE] == seen_counts[STAGE_NO_SERVICE]);
+
+    printf("%s: legacy %lu, known %lu, no service %lu\n",
+           scenarios[s].name,
+           (unsigned long)stage_counts[STAGE_NOT_EXTENDED],
+           (unsigned long)stage_counts[STAGE_KNOWN],
+           (unsigned long)stage_counts[STAGE_NO_SERVICE]);
+    printf("  lookup, then parse: %.1f ns per report\n", seen_ns);
+    printf("  parse, then lookup: %.1f ns per report\n", parse_ns);
+  }
+  return 0;
+}
@@ -0,0 +1,311 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host fuzz test of the advertising data parser: random and mutated payloads in buffers of
+ *         their exact size, truncated structures, and well formed payloads of known content
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stdbool.h>
+#include <string.h>
+#include "ad_parser.h"
+#include "ad_reference.h"
+#include "host_test.h"
+
+// Run longer with: build/fuzz_ad_parser <iterations>
+#define DEFAULT_ITERATIONS  200000
+#define MAX_ADV_LEN         255   // Extended advertising data of a scan report
+#define MAX_WELL_FORMED_LEN 191
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+// The CTE service of the application, and one pattern of each other kind
+static const ad_pattern_t patterns[] = {
+  { AD_PATTERN_SERVICE_UUID, 16, { 0x50, 0x69, 0x96, 0x81, 0xb7, 0xa8, 0xad, 0x07, 0x96, 0xf2, 0x3f, 0x07, 0x64, 0x36, 0xd0, 0x0e } },
+  { AD_PATTERN_SERVICE_UUID, 2, { 0x0f, 0x18 } },
+  { AD_PATTERN_SERVICE_DATA, 2, { 0xaa, 0xfe } },
+  { AD_PATTERN_MANUFACTURER, 2, { 0x4c, 0x00 } },
+};
+
+#define PATTERN_COUNT (sizeof(patterns) / sizeof(patterns[0]))
+
+// All AD_PARSER_MAX_PATTERNS patterns, some of no valid size
+static ad_pattern_t random_patterns[AD_PARSER_MAX_PATTERNS];
+
+static ad_pattern_set_t cte_set;
+static ad_pattern_set_t all_set;
+static ad_pattern_set_t random_set;
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+
+// Matched in a buffer of exactly len bytes, reads past it are caught by AddressSanitizer
+static uint32_t match_exact(const uint8_t *data, uint8_t len, const ad_pattern_set_t *set)
+{
+  uint8_t *copy = malloc(len > 0 ? len : 1);
+  uint32_t found;
+
+  CHECK(copy != NULL);
+  memcpy(copy, data, len);
+  found = ad_parser_match(copy, len, set);
+  free(copy);
+  return found;
+}
+
+static uint8_t random_bytes(uint8_t *data, uint8_t len)
+{
+  for (uint8_t i = 0; i < len; i++) {
+    data[i] = (uint8_t)host_test_random();
+  }
+  return len;
+}
+
+// One AD structure into field, without its length byte. Returns its length, and in found the
+// patterns it holds.
+static uint8_t make_field(uint8_t *field, uint32_t *found)
+{
+  uint8_t n = 0;
+  uint8_t count;
+
+  *found = 0;
+  switch (host_test_random() % 5) {
+    case 0:
+      // 128-bit UUID list
+      field[n++] = AD_TYPE_UUID128_COMPLETE - (host_test_random() & 1);
+      for (count = 1 + host_test_random() % 2; count > 0; count--, n += 16) {
+        if (host_test_random() % 4 == 0) {
+          memcpy(&field[n], patterns[0].value, 16);
+          *found |= 1 << 0;
+        } else {
+          random_bytes(&field[n], 16);
+        }
+      }
+      break;
+
+    case 1:
+      // 16-bit UUID list, the random ones are in the 0x8000 range unused by the pattern
+      field[n++] = AD_TYPE_UUID16_COMPLETE;
+      for (count = 1 + host_test_random() % 4; count > 0; count--, n += 2) {
+        if (host_test_random() % 4 == 0) {
+          memcpy(&field[n], patterns[1].value, 2);
+          *found |= 1 << 1;
+        } else {
+          field[n] = (uint8_t)host_test_random();
+          field[n + 1] = (uint8_t)host_test_random() | 0x80;
+        }
+      }
+      break;
+
+    case 2:
+      field[n++] = AD_TYPE_SERVICE_DATA_UUID16;
+      if (host_test_random() % 3 == 0) {
+        memcpy(&field[n], patterns[2].value, 2);
+        *found |= 1 << 2;
+      } else {
+        field[n] = (uint8_t)host_test_random();
+        field[n + 1] = 0x11;
+      }
+      n += 2;
+      n += random_bytes(&field[n], host_test_random() % 6);
+      break;
+
+    case 3:
+      field[n++] = AD_TYPE_MANUFACTURER_DATA;
+      if (host_test_random() % 3 == 0) {
+        memcpy(&field[n], patterns[3].value, 2);
+        *found |= 1 << 3;
+      } else {
+        field[n] = (uint8_t)host_test_random();
+        field[n + 1] = 0x12;
+      }
+      n += 2;
+      n += random_bytes(&field[n], host_test_random() % 8);
+      break;
+
+    default:
+      // Flags, names and the like
+      field[n++] = (host_test_random() & 1) ? 0x01 : 0x09;
+      n += random_bytes(&field[n], host_test_random() % 10);
+      break;
+  }
+  return n;
+}
+
+// Well formed advertising data, with the patterns it holds in found
+static uint8_t make_well_formed(uint8_t *data, uint32_t *found)
+{
+  uint8_t field[40];
+  uint8_t field_len;
+  uint32_t field_found;
+  uint8_t len = 0;
+
+  *found = 0;
+  while (1) {
+    field_len = make_field(field, &field_found);
+    if (len + 1 + field_len > MAX_WELL_FORMED_LEN || (len > 0 && host_test_random() % 3 == 0)) {
+      return len;
+    }
+    data[len++] = field_len;
+    memcpy(&data[len], field, field_len);
+    len += field_len;
+    *found |= field_found;
+  }
+}
+
+static void make_random_patterns(void)
+{
+  static const uint8_t lens[] = { 2, 4, 16, 3 };
+
+  for (uint8_t i = 0; i < AD_PARSER_MAX_PATTERNS; i++) {
+    random_patterns[i].kind = (uint8_t)(host_test_random() % 3);
+    random_patterns[i].len = lens[host_test_random() % 4];
+    random_bytes(random_patterns[i].value, sizeof(random_patterns[i].value));
+    // Few values, so that they do turn up in random data
+    random_patterns[i].value[0] &= 0x03;
+    random_patterns[i].value[1] &= 0x03;
+  }
+  ad_parser_set_init(&random_set, random_patterns, AD_PARSER_MAX_PATTERNS);
+}
+
+/***************************************************************************************************
+ * Tests
+ **************************************************************************************************/
+
+// Generated payloads of known content, also compared with the search the parser replaced
+static void test_well_formed(uint32_t iterations)
+{
+  uint8_t data[MAX_ADV_LEN];
+  uint8_t len;
+  uint32_t expected;
+  uint32_t found;
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    len = make_well_formed(data, &expected);
+    found = match_exact(data, len, &all_set);
+    CHECK(found == expected);
+    CHECK(match_exact(data, len, &cte_set) == (expected & 1));
+    CHECK(reference_find_service(data, len, patterns[0].value) == (found & 1));
+  }
+}
+
+// Structures cut short: a UUID split by the end of the list or of the data, service and
+// manufacturer data shorter than their identifier, and a structure running past the end
+static void test_truncated(void)
+{
+  uint8_t data[MAX_ADV_LEN];
+  uint8_t len;
+
+  // A whole UUID, then the first half of it: only the whole one counts
+  len = 0;
+  data[len++] = 1 + 16 + 8;
+  data[len++] = AD_TYPE_UUID128_COMPLETE;
+  memcpy(&data[len], patterns[0].value, 16);
+  len += 16;
+  memcpy(&data[len], patterns[0].value, 8);
+  len += 8;
+  CHECK(match_exact(data, len, &cte_set) == 1);
+
+  // Only a partial UUID in the list
+  data[0] = 1 + 8;
+  memcpy(&data[2], patterns[0].value, 8);
+  CHECK(match_exact(data, 2 + 8, &cte_set) == 0);
+
+  // The UUID cut by the end of the data, at every length, the length byte claiming all of it
+  data[0] = 1 + 16;
+  memcpy(&data[2], patterns[0].value, 16);
+  for (len = 0; len < 2 + 16; len++) {
+    CHECK(match_exact(data, len, &cte_set) == 0);
+  }
+  CHECK(match_exact(data, 2 + 16, &cte_set) == 1);
+
+  // Odd 16-bit UUID list, the pattern's first byte last
+  data[0] = 1 + 3;
+  data[1] = AD_TYPE_UUID16_INCOMPLETE;
+  data[2] = 0x00;
+  data[3] = 0x80;
+  data[4] = patterns[1].value[0];
+  CHECK(match_exact(data, 5, &all_set) == 0);
+
+  // Service and manufacturer data of one byte
+  data[0] = 2;
+  data[1] = AD_TYPE_SERVICE_DATA_UUID16;
+  data[2] = patterns[2].value[0];
+  data[3] = 2;
+  data[4] = AD_TYPE_MANUFACTURER_DATA;
+  data[5] = patterns[3].value[0];
+  CHECK(match_exact(data, 6, &all_set) == 0);
+
+  // A structure running past the end ends the parsing, the pattern after the flags is not read
+  data[0] = 2;
+  data[1] = 0x01;
+  data[2] = 0x06;
+  data[3] = 1 + 16 + 1;
+  data[4] = AD_TYPE_UUID128_COMPLETE;
+  memcpy(&data[5], patterns[0].value, 16);
+  CHECK(match_exact(data, 5 + 16, &cte_set) == 0);
+
+  // Well formed payloads cut anywhere: found as far as the structures are whole
+  for (uint32_t i = 0; i < 20000; i++) {
+    uint32_t expected;
+    uint8_t cut;
+
+    len = make_well_formed(data, &expected);
+    cut = (uint8_t)(host_test_random() % (len + 1));
+    CHECK(match_exact(data, cut, &all_set) == reference_match(data, cut, patterns, PATTERN_COUNT));
+  }
+}
+
+// Random bytes and mutated payloads, compared with the reference parser
+static void test_fuzz(uint32_t iterations)
+{
+  uint8_t data[MAX_ADV_LEN];
+  uint8_t len;
+  uint32_t expected;
+  uint8_t mutations;
+
+  for (uint32_t i = 0; i < iterations; i++) {
+    if (host_test_random() & 1) {
+      len = random_bytes(data, (uint8_t)(host_test_random() % (MAX_ADV_LEN + 1)));
+      // Short lengths and the pattern types, so that random data gets past the first structure
+      for (uint8_t n = 0; n < len; n += 1 + host_test_random() % 24) {
+        data[n] &= 0x1F;
+      }
+    } else {
+      len = make_well_formed(data, &expected);
+      for (mutations = 1 + host_test_random() % 4; mutations > 0 && len > 0; mutations--) {
+        data[host_test_random() % len] = (uint8_t)host_test_random();
+      }
+      if (len > 0 && (host_test_random() & 1)) {
+        len = (uint8_t)(host_test_random() % len);
+      }
+    }
+    CHECK(match_exact(data, len, &all_set) == reference_match(data, len, patterns, PATTERN_COUNT));
+    CHECK(match_exact(data, len, &cte_set) == reference_match(data, len, patterns, 1));
+    CHECK(match_exact(data, len, &random_set)
+          == reference_match(data, len, random_patterns, AD_PARSER_MAX_PATTERNS));
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t iterations = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+
+  ad_parser_set_init(&cte_set, patterns, 1);
+  ad_parser_set_init(&all_set, patterns, PATTERN_COUNT);
+  make_random_patterns();
+
+  test_well_formed(iterations);
+  test_truncated();
+  test_fuzz(iterations);
+  printf("fuzz_ad_parser: ok\n");
+  return 0;
+}
@@ -0,0 +1,69 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Checks and timing shared by the host tests and benchmarks
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Stop at the first failed check, the exit code fails the make target
+#define CHECK(cond)                                                  \
+  do {                                                               \
+    if (!(cond)) {                                                   \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+      exit(1);                                                       \
+    }                                                                \
+  } while (0)
+
+// Deterministic pseudo random numbers, failures reproduce from the seed
+static inline uint32_t host_test_random(void)
+{
+  static uint32_t state = 2463534242u;
+
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static inline double host_test_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Modules initialized once per boot are tested from a fresh process per test, stopped after
+// timeout_s if they hang
+static inline void host_test_run(void (*test)(void), unsigned int timeout_s)
+{
+  int status;
+  pid_t pid = fork();
+
+  CHECK(pid >= 0);
+  if (pid == 0) {
+    alarm(timeout_s);
+    test();
+    exit(0);
+  }
+  CHECK(waitpid(pid, &status, 0) == pid);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+#endif // HOST_TEST_H
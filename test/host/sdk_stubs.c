@@ -0,0 +1,237 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host implementation of the SDK functions used by the tested modules
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <string.h>
+#include "sl_sleeptimer.h"
+#include "sl_iostream.h"
+#include "nvm3_default.h"
+#include "sdk_stubs.h"
+
+#define NVM3_MAX_OBJECTS      8
+#define NVM3_MAX_OBJECT_SIZE  256
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct {
+  bool used;
+  nvm3_ObjectKey_t key;
+  size_t len;
+  uint8_t data[NVM3_MAX_OBJECT_SIZE];
+} nvm3_object_t;
+
+/***************************************************************************************************
+ * Public Variable Definitions
+ **************************************************************************************************/
+
+uint32_t sdk_stubs_time_ms;
+sdk_stubs_sync_t sdk_stubs_syncs[SDK_STUBS_MAX_SYNCS];
+sl_status_t sdk_stubs_open_status;
+uint32_t sdk_stubs_open_calls;
+uint32_t sdk_stubs_close_calls;
+uint32_t sdk_stubs_no_resource;
+
+nvm3_Handle_t *nvm3_defaultHandle;
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+static nvm3_object_t nvm3_objects[NVM3_MAX_OBJECTS];
+
+static char output[SDK_STUBS_OUTPUT_SIZE];
+static size_t output_len;
+
+static uint16_t next_skip;
+static uint16_t next_timeout;
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+void sdk_stubs_reset(void)
+{
+  sdk_stubs_time_ms = 0;
+  memset(sdk_stubs_syncs, 0, sizeof(sdk_stubs_syncs));
+  sdk_stubs_open_status = SL_STATUS_OK;
+  sdk_stubs_open_calls = 0;
+  sdk_stubs_close_calls = 0;
+  sdk_stubs_no_resource = 0;
+  memset(nvm3_objects, 0, sizeof(nvm3_objects));
+  sdk_stubs_clear_output();
+}
+
+uint8_t sdk_stubs_count_syncs(sdk_stubs_sync_state_t state)
+{
+  uint8_t count = 0;
+
+  for (uint16_t i = 0; i < SDK_STUBS_MAX_SYNCS; i++) {
+    if (sdk_stubs_syncs[i].state == state) {
+      count++;
+    }
+  }
+  return count;
+}
+
+const char* sdk_stubs_output(void)
+{
+  return output;
+}
+
+void sdk_stubs_clear_output(void)
+{
+  output_len = 0;
+  output[0] = '\0';
+}
+
+/***************************************************************************************************
+ * Sleeptimer
+ **************************************************************************************************/
+uint32_t sl_sleeptimer_get_tick_count(void)
+{
+  return sdk_stubs_time_ms;
+}
+
+uint32_t sl_sleeptimer_ms_to_tick(uint16_t time_ms)
+{
+  return time_ms;
+}
+
+uint32_t sl_sleeptimer_tick_to_ms(uint32_t tick)
+{
+  return tick;
+}
+
+// The wheel is stepped by the test calling timer_wheel_process(), the tick timer never fires
+sl_status_t sl_sleeptimer_start_periodic_timer_ms(sl_sleeptimer_timer_handle_t *handle,
+                                                  uint32_t timeout_ms,
+                                                  sl_sleeptimer_timer_callback_t callback,
+                                                  void *callback_data,
+                                                  uint8_t priority,
+                                                  uint16_t option_flags)
+{
+  handle->callback = callback;
+  handle->callback_data = callback_data;
+  return SL_STATUS_OK;
+}
+
+/***************************************************************************************************
+ * Bluetooth
+ **************************************************************************************************/
+sl_status_t sl_bt_sync_set_parameters(uint16_t skip, uint16_t timeout, uint32_t flags)
+{
+  next_skip = skip;
+  next_timeout = timeout;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_sync_open(bd_addr address, uint8_t address_type, uint8_t adv_sid, uint16_t *sync)
+{
+  sdk_stubs_sync_t *entry;
+
+  sdk_stubs_open_calls++;
+  if (sdk_stubs_open_status != SL_STATUS_OK) {
+    return sdk_stubs_open_status;
+  }
+  for (uint16_t i = 0; i < SDK_STUBS_MAX_SYNCS; i++) {
+    entry = &sdk_stubs_syncs[i];
+    if (entry->state != SDK_STUBS_SYNC_FREE) {
+      continue;
+    }
+    entry->state = SDK_STUBS_SYNC_OPENING;
+    entry->address = address;
+    entry->address_type = address_type;
+    entry->adv_sid = adv_sid;
+    entry->skip = next_skip;
+    entry->timeout = next_timeout;
+    entry->opened_ms = sdk_stubs_time_ms;
+    *sync = i;
+    return SL_STATUS_OK;
+  }
+  sdk_stubs_no_resource++;
+  return SL_STATUS_NO_MORE_RESOURCE;
+}
+
+sl_status_t sl_bt_sync_close(uint16_t sync)
+{
+  sdk_stubs_close_calls++;
+  if (sync >= SDK_STUBS_MAX_SYNCS
+      || (sdk_stubs_syncs[sync].state != SDK_STUBS_SYNC_OPENING
+          && sdk_stubs_syncs[sync].state != SDK_STUBS_SYNC_OPEN)) {
+    return SL_STATUS_INVALID_STATE;
+  }
+  sdk_stubs_syncs[sync].state = SDK_STUBS_SYNC_CLOSING;
+  return SL_STATUS_OK;
+}
+
+sl_status_t sl_bt_external_signal(uint32_t signals)
+{
+  return SL_STATUS_OK;
+}
+
+/***************************************************************************************************
+ * NVM3
+ **************************************************************************************************/
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value, size_t len)
+{
+  for (uint8_t i = 0; i < NVM3_MAX_OBJECTS; i++) {
+    if (nvm3_objects[i].used && nvm3_objects[i].key == key && nvm3_objects[i].len == len) {
+      memcpy(value, nvm3_objects[i].data, len);
+      return ECODE_NVM3_OK;
+    }
+  }
+  return ECODE_NVM3_ERR_KEY_NOT_FOUND;
+}
+
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, const void *value, size_t len)
+{
+  nvm3_object_t *object = NULL;
+
+  if (len > NVM3_MAX_OBJECT_SIZE) {
+    return ECODE_NVM3_ERR_WRITE_DATA_SIZE;
+  }
+  for (uint8_t i = 0; i < NVM3_MAX_OBJECTS; i++) {
+    if (nvm3_objects[i].used && nvm3_objects[i].key == key) {
+      object = &nvm3_objects[i];
+      break;
+    }
+    if (!nvm3_objects[i].used && object == NULL) {
+      object = &nvm3_objects[i];
+    }
+  }
+  if (object == NULL) {
+    return ECODE_NVM3_ERR_STORAGE_FULL;
+  }
+  object->used = true;
+  object->key = key;
+  object->len = len;
+  memcpy(object->data, value, len);
+  return ECODE_NVM3_OK;
+}
+
+/***************************************************************************************************
+ * I/O streams
+ **************************************************************************************************/
+sl_status_t sl_iostream_write(sl_iostream_t *stream, const void *buffer, size_t buffer_length)
+{
+  if (buffer_length >= SDK_STUBS_OUTPUT_SIZE) {
+    return SL_STATUS_FAIL;
+  }
+  if (output_len + buffer_length >= SDK_STUBS_OUTPUT_SIZE) {
+    sdk_stubs_clear_output();
+  }
+  memcpy(&output[output_len], buffer, buffer_length);
+  output_len += buffer_length;
+  output[output_len] = '\0';
+  return SL_STATUS_OK;
+}
@@ -0,0 +1,68 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Simulated clock, controller syncs, NVM3 and output behind the SDK stubs
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef SDK_STUBS_H
+#define SDK_STUBS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sl_bt_api.h"
+#include "sl_bluetooth_config.h"
+
+// Sync handles of the controller, as many as configured
+#define SDK_STUBS_MAX_SYNCS   SL_BT_CONFIG_MAX_PERIODIC_ADVERTISING_SYNC
+#define SDK_STUBS_OUTPUT_SIZE 8192
+
+// The controller side of a sync. The test plays the controller: it establishes the syncs being
+// opened, loses them, and delivers the closed events of the syncs closed by the application.
+typedef enum {
+  SDK_STUBS_SYNC_FREE = 0,
+  SDK_STUBS_SYNC_OPENING,     // sl_bt_sync_open() called, not established yet
+  SDK_STUBS_SYNC_OPEN,        // Established by the test
+  SDK_STUBS_SYNC_CLOSING      // sl_bt_sync_close() called, the closed event is due
+} sdk_stubs_sync_state_t;
+
+typedef struct {
+  uint8_t state;              // sdk_stubs_sync_state_t
+  bd_addr address;
+  uint8_t address_type;
+  uint8_t adv_sid;
+  uint16_t skip;              // Parameters set before the open
+  uint16_t timeout;
+  uint32_t opened_ms;
+} sdk_stubs_sync_t;
+
+// Simulated time, one sleeptimer tick per millisecond. Advanced by the test.
+extern uint32_t sdk_stubs_time_ms;
+
+// Indexed by the sync handle
+extern sdk_stubs_sync_t sdk_stubs_syncs[SDK_STUBS_MAX_SYNCS];
+
+// Returned by sl_bt_sync_open() without opening a sync, unless SL_STATUS_OK
+extern sl_status_t sdk_stubs_open_status;
+
+extern uint32_t sdk_stubs_open_calls;     // sl_bt_sync_open() calls, failed ones included
+extern uint32_t sdk_stubs_close_calls;
+extern uint32_t sdk_stubs_no_resource;    // Opens failed for lack of a free sync handle
+
+// Back to time 0, no syncs, empty NVM3 and output
+void sdk_stubs_reset(void);
+
+// Syncs in the given state
+uint8_t sdk_stubs_count_syncs(sdk_stubs_sync_state_t state);
+
+// All lines written since the last sdk_stubs_clear_output(), older ones are discarded on overflow
+const char* sdk_stubs_output(void);
+void sdk_stubs_clear_output(void);
+
+#endif // SDK_STUBS_H
@@ -0,0 +1,32 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host stub of NVM3, objects kept in RAM by sdk_stubs.c
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef NVM3_H
+#define NVM3_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint32_t Ecode_t;
+typedef uint32_t nvm3_ObjectKey_t;
+typedef struct nvm3_Handle nvm3_Handle_t;
+
+#define ECODE_NVM3_OK                  0x00000
+#define ECODE_NVM3_ERR_KEY_NOT_FOUND   0xF000E
+#define ECODE_NVM3_ERR_STORAGE_FULL    0xF0014
+#define ECODE_NVM3_ERR_WRITE_DATA_SIZE 0xF0016
+
+Ecode_t nvm3_readData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, void *value, size_t len);
+Ecode_t nvm3_writeData(nvm3_Handle_t *h, nvm3_ObjectKey_t key, const void *value, size_t len);
+
+#endif // NVM3_H
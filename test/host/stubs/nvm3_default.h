@@ -0,0 +1,21 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host stub of the default NVM3 instance
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef NVM3_DEFAULT_H
+#define NVM3_DEFAULT_H
+
+#include "nvm3.h"
+
+extern nvm3_Handle_t *nvm3_defaultHandle;
+
+#endif // NVM3_DEFAULT_H
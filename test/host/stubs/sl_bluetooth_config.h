@@ -0,0 +1,19 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host stub of the Bluetooth stack configuration, the values of config/
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef SL_BLUETOOTH_CONFIG_H
+#define SL_BLUETOOTH_CONFIG_H
+
+#define SL_BT_CONFIG_MAX_PERIODIC_ADVERTISING_SYNC 4
+
+#endif // SL_BLUETOOTH_CONFIG_H
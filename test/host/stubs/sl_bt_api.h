@@ -0,0 +1,44 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host stub of the Bluetooth API, only the types and commands the tested modules use
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef SL_BT_API_H
+#define SL_BT_API_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sl_status.h"
+
+typedef struct {
+  uint8_t addr[6];
+} bd_addr;
+
+typedef struct {
+  uint8_t len;
+  uint8_t data[];
+} uint8array;
+
+typedef enum {
+  gap_1m_phy    = 0x1,
+  gap_2m_phy    = 0x2,
+  gap_coded_phy = 0x4,
+  gap_any_phys  = 0xff
+} gap_phy_t;
+
+sl_status_t sl_bt_sync_set_parameters(uint16_t skip, uint16_t timeout, uint32_t flags);
+sl_status_t sl_bt_sync_open(bd_addr address, uint8_t address_type, uint8_t adv_sid, uint16_t *sync);
+sl_status_t sl_bt_sync_close(uint16_t sync);
+
+sl_status_t sl_bt_external_signal(uint32_t signals);
+
+#endif // SL_BT_API_H
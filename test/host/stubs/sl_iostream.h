@@ -0,0 +1,26 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host stub of the I/O streams, the output is captured by sdk_stubs.c
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef SL_IOSTREAM_H
+#define SL_IOSTREAM_H
+
+#include <stddef.h>
+#include "sl_status.h"
+
+typedef struct sl_iostream sl_iostream_t;
+
+#define SL_IOSTREAM_STDOUT ((sl_iostream_t *)0)
+
+sl_status_t sl_iostream_write(sl_iostream_t *stream, const void *buffer, size_t buffer_length);
+
+#endif // SL_IOSTREAM_H
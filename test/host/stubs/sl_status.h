@@ -0,0 +1,33 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host stub of the status codes, only those the tested modules use
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef SL_STATUS_H
+#define SL_STATUS_H
+
+#include <stdint.h>
+
+typedef uint32_t sl_status_t;
+
+#define SL_STATUS_OK                0x0000
+#define SL_STATUS_FAIL              0x0001
+#define SL_STATUS_INVALID_STATE     0x0002
+#define SL_STATUS_BUSY              0x0004
+#define SL_STATUS_IN_PROGRESS       0x0005
+#define SL_STATUS_FULL              0x000C
+#define SL_STATUS_NOT_FOUND         0x000E
+#define SL_STATUS_NOT_SUPPORTED     0x000F
+#define SL_STATUS_NO_MORE_RESOURCE  0x0019
+#define SL_STATUS_INVALID_PARAMETER 0x0021
+#define SL_STATUS_INVALID_RANGE     0x0028
+
+#endif // SL_STATUS_H
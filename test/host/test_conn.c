@@ -0,0 +1,173 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host test of the tag table: slot allocation, handle lookup and address index under churn
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "conn.h"
+#include "host_test.h"
+
+// Handles beyond the direct map exercise the fallback scan of find_slot()
+#define HANDLE_COUNT      (CONN_HANDLE_MAP_SIZE + 16)
+#define CHURN_ITERATIONS  200000
+// Colliding addresses cycled through the table
+#define ADDRESS_COUNT     40
+
+// The estimator state is not under test
+void aoa_tag_init(aoa_tag_state_t *tag_state, aoa_channel_group_t *group)
+{
+  (void)tag_state;
+  (void)group;
+}
+
+void aoa_tag_deinit(aoa_tag_state_t *tag_state)
+{
+  (void)tag_state;
+}
+
+static void make_address(uint16_t handle, bd_addr *address)
+{
+  for (uint8_t i = 0; i < sizeof(address->addr); i++) {
+    address->addr[i] = (uint8_t)(handle * 31 + i);
+  }
+}
+
+// Random adds and removes, checked against a model after every step. Live entries must keep
+// their slot and contents whatever happens to the others.
+static void test_churn(void)
+{
+  conn_properties_t *entries[HANDLE_COUNT] = { 0 };
+  uint8_t slots[HANDLE_COUNT];
+  uint8_t live = 0;
+  conn_properties_t *tag;
+  bd_addr address;
+  uint16_t handle;
+
+  init_connection();
+  for (uint32_t step = 0; step < CHURN_ITERATIONS; step++) {
+    handle = (uint16_t)(host_test_random() % HANDLE_COUNT);
+    make_address(handle, &address);
+
+    if (entries[handle] != NULL) {
+      CHECK(remove_connection(handle) == 0);
+      entries[handle] = NULL;
+      live--;
+      // Removed twice is an error, not a second removal
+      CHECK(remove_connection(handle) != 0);
+    } else {
+      tag = add_connection(handle, &address, (uint8_t)(handle & 1), 0);
+      if (live == AOA_MAX_TAGS) {
+        CHECK(tag == NULL);
+      } else {
+        CHECK(tag != NULL);
+        CHECK(tag->slot < AOA_MAX_TAGS);
+        entries[handle] = tag;
+        slots[handle] = tag->slot;
+        live++;
+      }
+    }
+
+    CHECK(get_connection_count() == live);
+    CHECK(is_connection_list_full() == (live == AOA_MAX_TAGS));
+    for (handle = 0; handle < HANDLE_COUNT; handle++) {
+      tag = get_connection_by_handle(handle);
+      if (entries[handle] == NULL) {
+        CHECK(tag == NULL);
+        continue;
+      }
+      make_address(handle, &address);
+      CHECK(tag == entries[handle]);
+      CHECK(tag->slot == slots[handle]);
+      CHECK(tag->connection_handle == handle);
+      CHECK(memcmp(&tag->address, &address, sizeof(bd_addr)) == 0);
+      CHECK(get_connection_by_index(tag->slot) == tag);
+    }
+  }
+}
+
+// Addresses whose hash lands in one of a few buckets, the last one included so that probe runs
+// wrap around the end of the index
+static void make_colliding_address(uint32_t n, bd_addr *address, uint8_t *address_type)
+{
+  uint32_t bucket;
+
+  do {
+    for (uint8_t i = 0; i < sizeof(address->addr); i++) {
+      address->addr[i] = (uint8_t)host_test_random();
+    }
+    *address_type = (uint8_t)(host_test_random() & 1);
+    bucket = conn_address_hash(address, *address_type) & (CONN_ADDRESS_INDEX_SIZE - 1);
+  } while (bucket != CONN_ADDRESS_INDEX_SIZE - 1 - (n % 3) && bucket != n % 3);
+}
+
+// Backward shift deletion must leave every remaining entry reachable from its home bucket.
+// Random inserts, deletes and lookups of colliding addresses, checked against a model.
+static void test_address_index(void)
+{
+  static bd_addr addresses[ADDRESS_COUNT];
+  static uint8_t address_types[ADDRESS_COUNT];
+  uint16_t handles[ADDRESS_COUNT];
+  bool live[ADDRESS_COUNT] = { false };
+  uint8_t live_count = 0;
+  conn_properties_t *tag;
+  bd_addr other;
+  uint32_t n;
+
+  for (n = 0; n < ADDRESS_COUNT; n++) {
+    make_colliding_address(n, &addresses[n], &address_types[n]);
+    handles[n] = (uint16_t)n;
+  }
+
+  init_connection();
+  for (uint32_t step = 0; step < CHURN_ITERATIONS; step++) {
+    n = host_test_random() % ADDRESS_COUNT;
+    if (live[n]) {
+      CHECK(remove_connection(handles[n]) == 0);
+      live[n] = false;
+      live_count--;
+    } else if (live_count < AOA_MAX_TAGS) {
+      CHECK(add_connection(handles[n], &addresses[n], address_types[n], 0) != NULL);
+      live[n] = true;
+      live_count++;
+    }
+
+    for (n = 0; n < ADDRESS_COUNT; n++) {
+      tag = get_connection_by_address(&addresses[n], address_types[n]);
+      if (!live[n]) {
+        CHECK(tag == NULL);
+        continue;
+      }
+      CHECK(tag != NULL);
+      CHECK(tag->connection_handle == handles[n]);
+      CHECK(memcmp(&tag->address, &addresses[n], sizeof(bd_addr)) == 0);
+      // The same address with the other type is another device
+      CHECK(get_connection_by_address(&addresses[n], address_types[n] ^ 1) == NULL);
+    }
+
+    // Addresses never added are not found, the probe stops at an empty bucket
+    for (uint8_t i = 0; i < sizeof(other.addr); i++) {
+      other.addr[i] = (uint8_t)host_test_random();
+    }
+    CHECK(get_connection_by_address(&other, 0) == NULL);
+  }
+}
+
+int main(void)
+{
+  // A broken index can leave no empty bucket, the probes would then never end
+  alarm(10);
+  test_churn();
+  test_address_index();
+  printf("test_conn: ok\n");
+  return 0;
+}
@@ -0,0 +1,263 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host test of the sync retry backoff, with failed opens, open timeouts and syncs the
+ *         controller never establishes
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stdbool.h>
+#include <string.h>
+#include "sync_sched.h"
+#include "timer_wheel.h"
+#include "conn.h"
+#include "cmd.h"
+#include "scan_policy.h"
+#include "sched.h"
+#include "tag_filter.h"
+#include "sdk_stubs.h"
+#include "host_test.h"
+
+#define STEP_MS             TIMER_WHEEL_TICK_MS
+#define ADV_INTERVAL        80    // 100 ms in 1.25 ms
+#define FAILED_ATTEMPTS     9     // Enough to reach the longest backoff and stay there
+#define NOT_ESTABLISHED_MS  500   // Until the controller reports a sync it could not establish
+
+typedef enum {
+  FAILURE_OPEN_ERROR,       // sl_bt_sync_open() fails
+  FAILURE_OPEN_TIMEOUT,     // The sync is never established, the open timeout gives up on it
+  FAILURE_NOT_ESTABLISHED   // The controller closes the sync before establishing it
+} failure_t;
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+static bd_addr address = { { 0x01, 0x02, 0x03, 0x5A, 0x05, 0x06 } };
+
+static failure_t failure;
+static bool establish;
+static bool present;
+
+// Times of the sl_bt_sync_open() calls
+static uint32_t attempts[FAILED_ATTEMPTS + 4];
+static uint8_t attempt_count;
+
+static uint32_t resync_failures;
+
+/***************************************************************************************************
+ * Application modules around the scheduler
+ **************************************************************************************************/
+void aoa_tag_init(aoa_tag_state_t *tag_state, aoa_channel_group_t *group)
+{
+  (void)tag_state;
+  (void)group;
+}
+
+void aoa_tag_deinit(aoa_tag_state_t *tag_state)
+{
+  (void)tag_state;
+}
+
+void scan_policy_update(void)
+{
+}
+
+void scan_policy_resync_failed(void)
+{
+  resync_failures++;
+}
+
+void sched_set_weight(conn_properties_t *tag, uint8_t weight)
+{
+  (void)tag;
+  (void)weight;
+}
+
+bool tag_filter_accept(const bd_addr *address)
+{
+  (void)address;
+  return true;
+}
+
+sl_status_t cmd_register(const char *name, cmd_handler_t handler)
+{
+  (void)name;
+  (void)handler;
+  return SL_STATUS_OK;
+}
+
+/***************************************************************************************************
+ * Simulation
+ **************************************************************************************************/
+
+static void run_controller(void)
+{
+  sdk_stubs_sync_t *sync;
+
+  for (uint16_t handle = 0; handle < SDK_STUBS_MAX_SYNCS; handle++) {
+    sync = &sdk_stubs_syncs[handle];
+    switch (sync->state) {
+      case SDK_STUBS_SYNC_OPENING:
+        if (establish) {
+          sync->state = SDK_STUBS_SYNC_OPEN;
+          CHECK(sync_sched_opened(handle, ADV_INTERVAL, gap_1m_phy) != NULL);
+        } else if (failure == FAILURE_NOT_ESTABLISHED
+                   && sdk_stubs_time_ms - sync->opened_ms >= NOT_ESTABLISHED_MS) {
+          sync->state = SDK_STUBS_SYNC_FREE;
+          sync_sched_closed(handle);
+        }
+        break;
+
+      case SDK_STUBS_SYNC_OPEN:
+        sync_sched_iq_received(handle);
+        break;
+
+      case SDK_STUBS_SYNC_CLOSING:
+        sync->state = SDK_STUBS_SYNC_FREE;
+        sync_sched_closed(handle);
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+static void record_attempts(uint32_t *open_calls)
+{
+  while (*open_calls < sdk_stubs_open_calls) {
+    (*open_calls)++;
+    CHECK(attempt_count < sizeof(attempts) / sizeof(attempts[0]));
+    attempts[attempt_count++] = sdk_stubs_time_ms;
+  }
+}
+
+// One wheel tick: timers, controller events, then the scan report of the tag
+static void run(uint32_t ms)
+{
+  uint32_t open_calls = sdk_stubs_open_calls;
+
+  for (uint32_t t = 0; t < ms; t += STEP_MS) {
+    sdk_stubs_time_ms += STEP_MS;
+    timer_wheel_process();
+    record_attempts(&open_calls);
+    run_controller();
+    record_attempts(&open_calls);
+    if (present && sync_sched_seen(&address, 0, -60) == NULL) {
+      CHECK(sync_sched_add(&address, 0, 1, -60) != NULL);
+    }
+    record_attempts(&open_calls);
+  }
+}
+
+static void set_failure(failure_t new_failure)
+{
+  failure = new_failure;
+  sdk_stubs_open_status = (failure == FAILURE_OPEN_ERROR) ? SL_STATUS_NO_MORE_RESOURCE
+                          : SL_STATUS_OK;
+  establish = false;
+}
+
+// Time from a failed attempt to its failure
+static uint32_t failure_delay(void)
+{
+  switch (failure) {
+    case FAILURE_OPEN_TIMEOUT:
+      return SYNC_SCHED_OPEN_TIMEOUT_MS;
+    case FAILURE_NOT_ESTABLISHED:
+      return NOT_ESTABLISHED_MS;
+    default:
+      return 0;
+  }
+}
+
+// Retries after 1, 2, 4, 8, 16 and then 32 s, counted from the failure of the previous attempt
+static void check_schedule(uint8_t first, uint8_t count)
+{
+  uint32_t backoff;
+  uint8_t steps;
+
+  for (uint8_t i = 0; i + 1 < count; i++) {
+    steps = (i < SYNC_SCHED_MAX_BACKOFF_STEPS) ? i : SYNC_SCHED_MAX_BACKOFF_STEPS;
+    backoff = (uint32_t)SYNC_SCHED_RETRY_MS << steps;
+    CHECK(attempts[first + i + 1] - attempts[first + i] == failure_delay() + backoff);
+  }
+}
+
+static void test_backoff(failure_t new_failure)
+{
+  uint8_t first;
+
+  sdk_stubs_reset();
+  timer_wheel_init();
+  sync_sched_init();
+  sync_sched_start();
+  resync_failures = 0;
+  attempt_count = 0;
+  set_failure(new_failure);
+
+  // The tag stays in range all along, it is not reaped while backing off
+  present = true;
+  while (attempt_count < FAILED_ATTEMPTS) {
+    run(STEP_MS);
+  }
+  CHECK(attempts[0] == STEP_MS);
+  check_schedule(0, FAILED_ATTEMPTS);
+  CHECK(resync_failures == 0);
+
+  // Synced at the attempt after the longest backoff, which ends the backoff
+  run(failure_delay());
+  sdk_stubs_open_status = SL_STATUS_OK;
+  establish = true;
+  run(SYNC_SCHED_RETRY_MS << SYNC_SCHED_MAX_BACKOFF_STEPS);
+  CHECK(attempt_count == FAILED_ATTEMPTS + 1);
+  CHECK(sdk_stubs_count_syncs(SDK_STUBS_SYNC_OPEN) == 1);
+
+  // Lost and reopened right away, failing again: the backoff starts over from the shortest
+  set_failure(new_failure);
+  for (uint16_t handle = 0; handle < SDK_STUBS_MAX_SYNCS; handle++) {
+    if (sdk_stubs_syncs[handle].state == SDK_STUBS_SYNC_OPEN) {
+      sdk_stubs_syncs[handle].state = SDK_STUBS_SYNC_FREE;
+      sync_sched_closed(handle);
+    }
+  }
+  first = attempt_count;
+  CHECK(sdk_stubs_open_calls == first + 1u);
+  attempts[attempt_count++] = sdk_stubs_time_ms;
+  run(SYNC_SCHED_RETRY_MS * 4 + failure_delay() * 3);
+  CHECK(attempt_count == first + 3);
+  check_schedule(first, 3);
+  // The scan policy hears of the failed resync once
+  CHECK(resync_failures == 1);
+}
+
+static void test_open_error(void)
+{
+  test_backoff(FAILURE_OPEN_ERROR);
+}
+
+static void test_open_timeout(void)
+{
+  test_backoff(FAILURE_OPEN_TIMEOUT);
+}
+
+static void test_not_established(void)
+{
+  test_backoff(FAILURE_NOT_ESTABLISHED);
+}
+
+int main(void)
+{
+  host_test_run(test_open_error, 10);
+  host_test_run(test_open_timeout, 10);
+  host_test_run(test_not_established, 10);
+  printf("test_sync_backoff: ok\n");
+  return 0;
+}
@@ -0,0 +1,624 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Host simulation of the sync scheduler with more tags than entries, under each eviction
+ *         policy, against a simulated controller
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stdbool.h>
+#include <string.h>
+#include "sync_sched.h"
+#include "timer_wheel.h"
+#include "conn.h"
+#include "cmd.h"
+#include "scan_policy.h"
+#include "sched.h"
+#include "tag_filter.h"
+#include "sdk_stubs.h"
+#include "host_test.h"
+
+// More tags than the scheduler keeps entries for
+#define TAG_COUNT           (SYNC_SCHED_MAX_TAGS + 16)
+#define STEP_MS             TIMER_WHEEL_TICK_MS
+#define ADV_INTERVAL        80    // 100 ms in 1.25 ms
+#define SIM_STEPS           12000 // 20 minutes of churn per policy
+#define SIM_LEAVE_CHANCE    400   // 1 in n per step, a tag stays for 40 s on average
+#define SIM_RETURN_CHANCE   300
+#define SIM_UNSYNCABLE      5     // 1 in n tags has a periodic train the controller cannot follow
+
+// A tag as seen over the air
+typedef struct {
+  bd_addr address;
+  int8_t rssi;
+  bool present;             // Advertising in range of the locator
+  bool syncable;            // Its periodic train can be synced to
+} sim_tag_t;
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+static sim_tag_t sim_tags[TAG_COUNT];
+
+// Entries of the scheduler as returned by it. The first tag admitted to an empty scheduler takes
+// the first entry, the others are found from there.
+static sync_tag_t *entries;
+static uint8_t entry_count;
+
+// The controller holds back the sync closed events, as when it is busy
+static bool hold_closed_events;
+static uint32_t lost_ms[SDK_STUBS_MAX_SYNCS];
+
+static struct {
+  const char *name;
+  cmd_handler_t handler;
+} commands[CMD_MAX_COMMANDS];
+static uint8_t command_count;
+
+// Admissions of the simulation that took a victim's entry, right away or pending its sync
+static uint32_t victims_taken;
+static uint32_t victims_stale;
+
+/***************************************************************************************************
+ * Application modules around the scheduler
+ **************************************************************************************************/
+void aoa_tag_init(aoa_tag_state_t *tag_state, aoa_channel_group_t *group)
+{
+  (void)tag_state;
+  (void)group;
+}
+
+void aoa_tag_deinit(aoa_tag_state_t *tag_state)
+{
+  (void)tag_state;
+}
+
+void scan_policy_update(void)
+{
+}
+
+void scan_policy_resync_failed(void)
+{
+}
+
+void sched_set_weight(conn_properties_t *tag, uint8_t weight)
+{
+  (void)tag;
+  (void)weight;
+}
+
+bool tag_filter_accept(const bd_addr *address)
+{
+  (void)address;
+  return true;
+}
+
+sl_status_t cmd_register(const char *name, cmd_handler_t handler)
+{
+  for (uint8_t i = 0; i < command_count; i++) {
+    if (strcmp(commands[i].name, name) == 0) {
+      commands[i].handler = handler;
+      return SL_STATUS_OK;
+    }
+  }
+  CHECK(command_count < CMD_MAX_COMMANDS);
+  commands[command_count].name = name;
+  commands[command_count].handler = handler;
+  command_count++;
+  return SL_STATUS_OK;
+}
+
+/***************************************************************************************************
+ * Simulation
+ **************************************************************************************************/
+
+// Split at the commas as the command line does, without the leading '$'
+static sl_status_t command(const char *line)
+{
+  char buffer[CMD_LINE_MAX_LEN];
+  char *argv[CMD_MAX_ARGS];
+  uint8_t argc = 0;
+  char *token = buffer;
+
+  snprintf(buffer, sizeof(buffer), "%s", line);
+  while (token != NULL && argc < CMD_MAX_ARGS) {
+    argv[argc++] = token;
+    token = strchr(token, ',');
+    if (token != NULL) {
+      *token++ = '\0';
+    }
+  }
+  for (uint8_t i = 0; i < command_count; i++) {
+    if (strcmp(commands[i].name, argv[0]) == 0) {
+      return commands[i].handler(argc, argv);
+    }
+  }
+  return SL_STATUS_NOT_FOUND;
+}
+
+static void set_priority(const sim_tag_t *tag, uint8_t priority)
+{
+  char line[48];
+
+  snprintf(line, sizeof(line), "PRIORITY,%llu,%u", conn_address_to_id(&tag->address), priority);
+  CHECK(command(line) == SL_STATUS_OK);
+}
+
+// Fields of the last $SYNC line
+static void read_statistics(unsigned int fields[9])
+{
+  const char *line = NULL;
+  const char *next = sdk_stubs_output();
+
+  while ((next = strstr(next, "$SYNC,")) != NULL) {
+    line = next++;
+  }
+  CHECK(line != NULL);
+  CHECK(sscanf(line, "$SYNC,%u,%u,%u,%u,%u,%u,%u,%u,%u", &fields[0], &fields[1], &fields[2],
+               &fields[3], &fields[4], &fields[5], &fields[6], &fields[7], &fields[8]) == 9);
+}
+
+static void init_tags(void)
+{
+  for (uint8_t i = 0; i < TAG_COUNT; i++) {
+    memset(&sim_tags[i], 0, sizeof(sim_tags[i]));
+    sim_tags[i].address.addr[0] = i;
+    sim_tags[i].address.addr[3] = 0x5A;
+    sim_tags[i].rssi = -60;
+    sim_tags[i].syncable = true;
+  }
+}
+
+static sim_tag_t* find_sim_tag(const bd_addr *address)
+{
+  for (uint8_t i = 0; i < TAG_COUNT; i++) {
+    if (memcmp(&sim_tags[i].address, address, sizeof(bd_addr)) == 0) {
+      return &sim_tags[i];
+    }
+  }
+  return NULL;
+}
+
+static void observe(sync_tag_t *entry)
+{
+  uint8_t index;
+
+  if (entries == NULL) {
+    entries = entry;
+  }
+  CHECK(entry >= entries);
+  index = (uint8_t)(entry - entries);
+  CHECK(index < SYNC_SCHED_MAX_TAGS);
+  if (index >= entry_count) {
+    entry_count = index + 1;
+  }
+}
+
+// Entry of the tag, without refreshing it as a scan report would
+static sync_tag_t* find_entry(const sim_tag_t *tag)
+{
+  for (uint8_t i = 0; i < entry_count; i++) {
+    if (entries[i].state != SYNC_STATE_FREE
+        && memcmp(&entries[i].address, &tag->address, sizeof(bd_addr)) == 0) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+static bool is_stale(const sync_tag_t *entry)
+{
+  return sdk_stubs_time_ms - entry->last_seen_tick >= SYNC_SCHED_SEEN_TIMEOUT_MS;
+}
+
+// The victim and the admission as documented with sync_eviction_t
+static sync_tag_t* expected_victim(sync_eviction_t policy)
+{
+  sync_tag_t *victim = NULL;
+  sync_tag_t *entry;
+  bool lower;
+
+  for (uint8_t i = 0; i < entry_count; i++) {
+    entry = &entries[i];
+    if (entry->state == SYNC_STATE_FREE || entry->evict) {
+      continue;
+    }
+    if (victim == NULL) {
+      victim = entry;
+      continue;
+    }
+    switch (policy) {
+      case SYNC_EVICT_WEAKEST_RSSI:
+        lower = entry->rssi < victim->rssi;
+        break;
+      case SYNC_EVICT_LOWEST_PRIORITY:
+        lower = entry->priority < victim->priority
+                || (entry->priority == victim->priority
+                    && (int32_t)(entry->last_seen_tick - victim->last_seen_tick) < 0);
+        break;
+      default:
+        lower = (int32_t)(entry->last_seen_tick - victim->last_seen_tick) < 0;
+        break;
+    }
+    if (lower) {
+      victim = entry;
+    }
+  }
+  return victim;
+}
+
+static bool expected_admission(sync_eviction_t policy, const sync_tag_t *victim, int8_t rssi)
+{
+  switch (policy) {
+    case SYNC_EVICT_WEAKEST_RSSI:
+      return is_stale(victim) || rssi > victim->rssi + SYNC_SCHED_EVICT_RSSI_MARGIN;
+    case SYNC_EVICT_LOWEST_PRIORITY:
+      return is_stale(victim) || victim->priority < SYNC_SCHED_DEFAULT_PRIORITY;
+    default:
+      return is_stale(victim);
+  }
+}
+
+// New tag found by the scanner, checked against the documented eviction
+static void add_tag(sim_tag_t *tag, sync_eviction_t policy)
+{
+  sync_tag_t *victim = NULL;
+  sync_tag_t *entry;
+  bool full = (entry_count == SYNC_SCHED_MAX_TAGS);
+  bool pending = false;
+  bool admitted;
+  uint8_t victim_state = SYNC_STATE_FREE;
+  uint32_t closes = sdk_stubs_close_calls;
+
+  for (uint8_t i = 0; i < entry_count; i++) {
+    if (entries[i].state == SYNC_STATE_FREE) {
+      full = false;
+    } else if (entries[i].evict) {
+      pending = true;
+    }
+  }
+  if (full && !pending) {
+    victim = expected_victim(policy);
+    victim_state = victim->state;
+  }
+  admitted = !full || (!pending && expected_admission(policy, victim, tag->rssi));
+  if (admitted && victim != NULL && is_stale(victim)) {
+    victims_stale++;
+  }
+
+  entry = sync_sched_add(&tag->address, 0, 1, tag->rssi);
+
+  if (!full) {
+    CHECK(entry != NULL);
+  } else if (!admitted) {
+    // Rejected, or waiting for the entry already being freed
+    CHECK(entry == NULL);
+    CHECK(sdk_stubs_close_calls == closes);
+  } else if (victim_state == SYNC_STATE_IDLE || victim_state == SYNC_STATE_BACKOFF) {
+    // Entry taken over right away
+    CHECK(entry == victim);
+    victims_taken++;
+  } else {
+    // The victim's sync is closed first, one victim per admission
+    CHECK(entry == NULL);
+    CHECK(victim->evict);
+    CHECK(sdk_stubs_close_calls - closes <= 1);
+    victims_taken++;
+  }
+  if (entry != NULL) {
+    observe(entry);
+    CHECK(memcmp(&entry->address, &tag->address, sizeof(bd_addr)) == 0);
+  }
+}
+
+// The controller side: syncs are established for tags in range, lost after the sync timeout out of
+// range, and closed events follow the closes of the application
+static void run_controller(void)
+{
+  sdk_stubs_sync_t *sync;
+  sim_tag_t *tag;
+  sync_tag_t *entry;
+
+  for (uint16_t handle = 0; handle < SDK_STUBS_MAX_SYNCS; handle++) {
+    sync = &sdk_stubs_syncs[handle];
+    tag = find_sim_tag(&sync->address);
+    switch (sync->state) {
+      case SDK_STUBS_SYNC_OPENING:
+        if (tag->present && tag->syncable) {
+          sync->state = SDK_STUBS_SYNC_OPEN;
+          lost_ms[handle] = 0;
+          entry = sync_sched_opened(handle, ADV_INTERVAL, gap_1m_phy);
+          if (entry == NULL) {
+            CHECK(sl_bt_sync_close(handle) == SL_STATUS_OK);
+          }
+        }
+        break;
+
+      case SDK_STUBS_SYNC_OPEN:
+        if (tag->present) {
+          lost_ms[handle] = 0;
+          sync_sched_iq_received(handle);
+        } else if ((lost_ms[handle] += STEP_MS) >= sync->timeout * 10u) {
+          sync->state = SDK_STUBS_SYNC_FREE;
+          sync_sched_closed(handle);
+        }
+        break;
+
+      case SDK_STUBS_SYNC_CLOSING:
+        if (!hold_closed_events) {
+          sync->state = SDK_STUBS_SYNC_FREE;
+          sync_sched_closed(handle);
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+static void check_invariants(void)
+{
+  uint8_t opening;
+  uint8_t in_use;
+  uint8_t known = 0;
+
+  // The scheduler's syncs are the controller's, never more than there are
+  sync_sched_get_syncs(&opening, &in_use);
+  CHECK(in_use == SDK_STUBS_MAX_SYNCS - sdk_stubs_count_syncs(SDK_STUBS_SYNC_FREE));
+  CHECK(opening == sdk_stubs_count_syncs(SDK_STUBS_SYNC_OPENING));
+  CHECK(in_use <= SYNC_SCHED_MAX_SYNCS);
+  CHECK(sdk_stubs_no_resource == 0);
+
+  // Each tag known once
+  for (uint8_t i = 0; i < entry_count; i++) {
+    if (entries[i].state == SYNC_STATE_FREE) {
+      continue;
+    }
+    known++;
+    for (uint8_t j = i + 1; j < entry_count; j++) {
+      CHECK(entries[j].state == SYNC_STATE_FREE
+            || memcmp(&entries[i].address, &entries[j].address, sizeof(bd_addr)) != 0);
+    }
+  }
+  CHECK(known <= SYNC_SCHED_MAX_TAGS);
+}
+
+// One wheel tick: timers, controller events, then the scan reports of the tags in range
+static void step(sync_eviction_t policy)
+{
+  sync_tag_t *entry;
+
+  sdk_stubs_time_ms += STEP_MS;
+  timer_wheel_process();
+  run_controller();
+  for (uint8_t i = 0; i < TAG_COUNT; i++) {
+    if (!sim_tags[i].present) {
+      continue;
+    }
+    entry = sync_sched_seen(&sim_tags[i].address, 0, sim_tags[i].rssi);
+    if (entry == NULL) {
+      add_tag(&sim_tags[i], policy);
+    }
+  }
+  check_invariants();
+}
+
+static void run(sync_eviction_t policy, uint32_t ms)
+{
+  for (uint32_t t = 0; t < ms; t += STEP_MS) {
+    step(policy);
+  }
+}
+
+// As after a reset
+static void boot(sync_eviction_t policy)
+{
+  static const char *names[] = { "EVICT,STALE", "EVICT,RSSI", "EVICT,PRIORITY" };
+
+  sdk_stubs_reset();
+  init_tags();
+  entries = NULL;
+  entry_count = 0;
+  hold_closed_events = false;
+  timer_wheel_init();
+  sync_sched_init();
+  sync_sched_start();
+  CHECK(command(names[policy]) == SL_STATUS_OK);
+}
+
+/***************************************************************************************************
+ * Tests
+ **************************************************************************************************/
+
+// Known tags only make room for new ones once they are stale
+static void test_stalest(void)
+{
+  unsigned int fields[9];
+
+  boot(SYNC_EVICT_STALEST);
+  for (uint8_t i = 0; i < SYNC_SCHED_MAX_TAGS + 8; i++) {
+    sim_tags[i].present = true;
+    sim_tags[i].rssi = (i < SYNC_SCHED_MAX_TAGS) ? -80 : -40;
+  }
+  run(SYNC_EVICT_STALEST, 30000);
+  for (uint8_t i = 0; i < TAG_COUNT; i++) {
+    CHECK((find_entry(&sim_tags[i]) != NULL) == (i < SYNC_SCHED_MAX_TAGS));
+  }
+  read_statistics(fields);
+  CHECK(fields[0] == SYNC_SCHED_MAX_TAGS);
+  CHECK(fields[4] == 0);
+  CHECK(fields[5] > 0);
+
+  // The first tags leave, the waiting ones take their entries
+  for (uint8_t i = 0; i < 8; i++) {
+    sim_tags[i].present = false;
+  }
+  run(SYNC_EVICT_STALEST, SYNC_SCHED_SEEN_TIMEOUT_MS + 5000);
+  for (uint8_t i = 0; i < TAG_COUNT; i++) {
+    CHECK((find_entry(&sim_tags[i]) != NULL) == (i >= 8 && i < SYNC_SCHED_MAX_TAGS + 8));
+  }
+}
+
+// Stronger tags replace the weakest ones by the margin, one at a time, also when the victim holds
+// a sync whose closed event is late
+static void test_weakest_rssi(void)
+{
+  sync_tag_t *victim;
+  uint32_t closes;
+  uint8_t victim_index;
+
+  boot(SYNC_EVICT_WEAKEST_RSSI);
+  // The first tags get the syncs, and they are the weakest
+  for (uint8_t i = 0; i < SYNC_SCHED_MAX_TAGS; i++) {
+    sim_tags[i].present = true;
+    sim_tags[i].rssi = (int8_t)(-90 + i);
+  }
+  run(SYNC_EVICT_WEAKEST_RSSI, 500);
+  victim = find_entry(&sim_tags[0]);
+  CHECK(victim != NULL);
+  CHECK(victim->state == SYNC_STATE_SYNCED);
+  victim_index = (uint8_t)(victim - entries);
+
+  // A strong new tag keeps advertising while the victim's sync closes
+  hold_closed_events = true;
+  closes = sdk_stubs_close_calls;
+  sim_tags[SYNC_SCHED_MAX_TAGS].present = true;
+  sim_tags[SYNC_SCHED_MAX_TAGS].rssi = -50;
+  run(SYNC_EVICT_WEAKEST_RSSI, 1000);
+  CHECK(sdk_stubs_close_calls - closes == 1);
+  CHECK(victim->evict);
+  CHECK(victim->state == SYNC_STATE_CLOSING);
+  CHECK(find_entry(&sim_tags[SYNC_SCHED_MAX_TAGS]) == NULL);
+  for (uint8_t i = 1; i < SYNC_SCHED_MAX_TAGS; i++) {
+    CHECK(find_entry(&sim_tags[i]) != NULL);
+  }
+
+  // It takes the victim's entry once the sync has closed. The victim is not stronger than the
+  // next weakest by the margin, it stays out.
+  hold_closed_events = false;
+  run(SYNC_EVICT_WEAKEST_RSSI, 1000);
+  CHECK(find_entry(&sim_tags[SYNC_SCHED_MAX_TAGS]) == &entries[victim_index]);
+  CHECK(find_entry(&sim_tags[0]) == NULL);
+
+  // Weakest now at -89: -87 is within the margin, -85 beyond it
+  sim_tags[SYNC_SCHED_MAX_TAGS + 1].present = true;
+  sim_tags[SYNC_SCHED_MAX_TAGS + 1].rssi = -87;
+  run(SYNC_EVICT_WEAKEST_RSSI, 1000);
+  CHECK(find_entry(&sim_tags[SYNC_SCHED_MAX_TAGS + 1]) == NULL);
+  CHECK(find_entry(&sim_tags[1]) != NULL);
+  sim_tags[SYNC_SCHED_MAX_TAGS + 2].present = true;
+  sim_tags[SYNC_SCHED_MAX_TAGS + 2].rssi = -85;
+  run(SYNC_EVICT_WEAKEST_RSSI, 1000);
+  CHECK(find_entry(&sim_tags[SYNC_SCHED_MAX_TAGS + 2]) != NULL);
+  CHECK(find_entry(&sim_tags[1]) == NULL);
+}
+
+// No known tag is below the default priority: a fresh tag is never given up, however strong the
+// new one. Stale ones go lowest priority first.
+static void test_lowest_priority(void)
+{
+  unsigned int fields[9];
+
+  boot(SYNC_EVICT_LOWEST_PRIORITY);
+  for (uint8_t i = 0; i < TAG_COUNT; i++) {
+    sim_tags[i].present = (i < SYNC_SCHED_MAX_TAGS);
+    sim_tags[i].rssi = (i < SYNC_SCHED_MAX_TAGS) ? -90 : -40;
+  }
+  run(SYNC_EVICT_LOWEST_PRIORITY, 1000);
+  for (uint8_t i = 8; i < SYNC_SCHED_MAX_TAGS; i++) {
+    set_priority(&sim_tags[i], 2);
+  }
+  CHECK(find_entry(&sim_tags[8])->priority == 2);
+
+  for (uint8_t i = SYNC_SCHED_MAX_TAGS; i < TAG_COUNT; i++) {
+    sim_tags[i].present = true;
+  }
+  run(SYNC_EVICT_LOWEST_PRIORITY, 20000);
+  for (uint8_t i = 0; i < TAG_COUNT; i++) {
+    CHECK((find_entry(&sim_tags[i]) != NULL) == (i < SYNC_SCHED_MAX_TAGS));
+  }
+  read_statistics(fields);
+  CHECK(fields[4] == 0);
+  CHECK(fields[5] > 0);
+
+  // The policy is kept in NVM3
+  sdk_stubs_clear_output();
+  CHECK(command("EVICT") == SL_STATUS_OK);
+  CHECK(strcmp(sdk_stubs_output(), "$EVICT,PRIORITY\n") == 0);
+  CHECK(command("EVICT,OLDEST") == SL_STATUS_INVALID_PARAMETER);
+}
+
+// Tags coming and going at random, each admission checked against the documented policy
+static void test_churn(sync_eviction_t policy)
+{
+  sim_tag_t *tag;
+
+  boot(policy);
+  victims_taken = 0;
+  victims_stale = 0;
+  for (uint8_t i = 0; i < TAG_COUNT; i++) {
+    sim_tags[i].present = (host_test_random() % 2 == 0);
+    sim_tags[i].rssi = (int8_t)(-95 + (int)(host_test_random() % 50));
+    sim_tags[i].syncable = (host_test_random() % SIM_UNSYNCABLE != 0);
+  }
+
+  for (uint32_t s = 0; s < SIM_STEPS; s++) {
+    for (uint8_t i = 0; i < TAG_COUNT; i++) {
+      tag = &sim_tags[i];
+      if (tag->present ? (host_test_random() % SIM_LEAVE_CHANCE == 0)
+          : (host_test_random() % SIM_RETURN_CHANCE == 0)) {
+        tag->present = !tag->present;
+      }
+    }
+    // Priorities changed now and then
+    tag = &sim_tags[host_test_random() % TAG_COUNT];
+    if (host_test_random() % 50 == 0 && find_entry(tag) != NULL) {
+      set_priority(tag, (uint8_t)(1 + host_test_random() % 3));
+    }
+    step(policy);
+  }
+
+  // The simulation went through evictions, only the RSSI policy gives up tags that are not stale
+  CHECK(victims_taken > 0);
+  CHECK(victims_stale > 0);
+  if (policy == SYNC_EVICT_WEAKEST_RSSI) {
+    CHECK(victims_taken > victims_stale);
+  } else {
+    CHECK(victims_taken == victims_stale);
+  }
+}
+
+static void test_churn_stalest(void)
+{
+  test_churn(SYNC_EVICT_STALEST);
+}
+
+static void test_churn_weakest_rssi(void)
+{
+  test_churn(SYNC_EVICT_WEAKEST_RSSI);
+}
+
+static void test_churn_lowest_priority(void)
+{
+  test_churn(SYNC_EVICT_LOWEST_PRIORITY);
+}
+
+int main(void)
+{
+  host_test_run(test_stalest, 30);
+  host_test_run(test_weakest_rssi, 30);
+  host_test_run(test_lowest_priority, 30);
+  host_test_run(test_churn_stalest, 30);
+  host_test_run(test_churn_weakest_rssi, 30);
+  host_test_run(test_churn_lowest_priority, 30);
+  printf("test_sync_sched: ok\n");
+  return 0;
+}
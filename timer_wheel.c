@@ -0,0 +1,182 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Hierarchical timer wheel. Runs any number of application timeouts from a single
+ *         sleeptimer, with O(1) start, stop and per tick cost.
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#include <stddef.h>
+#include "sl_sleeptimer.h"
+#include "sl_bt_api.h"
+#include "timer_wheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+/***************************************************************************************************
+ * Static Variable Declarations
+ **************************************************************************************************/
+
+// Circular lists with the slot itself as the list head
+static timer_wheel_timer_t slots[2][TIMER_WHEEL_SLOTS];
+
+static sl_sleeptimer_timer_handle_t tick_timer;
+
+// Wheel position, and the sleeptimer tick it corresponds to
+static uint32_t current;
+static uint32_t current_tick;
+static uint32_t ticks_per_slot;
+
+/***************************************************************************************************
+ * Static Function Declarations
+ **************************************************************************************************/
+
+static void tick_timer_cb(sl_sleeptimer_timer_handle_t *handle, void *data);
+static void advance(void);
+static void insert(timer_wheel_timer_t *timer);
+static void detach(timer_wheel_timer_t *timer);
+static uint32_t ms_to_ticks(uint32_t ms);
+
+/***************************************************************************************************
+ * Public Function Definitions
+ **************************************************************************************************/
+void timer_wheel_init(void)
+{
+  for (uint8_t level = 0; level < 2; level++) {
+    for (uint16_t i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+      slots[level][i].next = &slots[level][i];
+      slots[level][i].prev = &slots[level][i];
+    }
+  }
+  current = 0;
+  current_tick = sl_sleeptimer_get_tick_count();
+  ticks_per_slot = sl_sleeptimer_ms_to_tick(TIMER_WHEEL_TICK_MS);
+
+  sl_sleeptimer_start_periodic_timer_ms(&tick_timer, TIMER_WHEEL_TICK_MS, tick_timer_cb, NULL, 0, 0);
+}
+
+void timer_wheel_start(timer_wheel_timer_t *timer,
+                       uint32_t timeout_ms,
+                       uint32_t period_ms,
+                       timer_wheel_callback_t callback,
+                       void *data)
+{
+  if (timer->next != NULL) {
+    detach(timer);
+  }
+  timer->expiry = current + ms_to_ticks(timeout_ms);
+  timer->period = (period_ms > 0) ? ms_to_ticks(period_ms) : 0;
+  timer->callback = callback;
+  timer->data = data;
+  insert(timer);
+}
+
+void timer_wheel_stop(timer_wheel_timer_t *timer)
+{
+  if (timer->next != NULL) {
+    detach(timer);
+  }
+}
+
+bool timer_wheel_is_running(const timer_wheel_timer_t *timer)
+{
+  return timer->next != NULL;
+}
+
+void timer_wheel_process(void)
+{
+  uint32_t now = sl_sleeptimer_get_tick_count();
+
+  // Signals raised while the stack was busy are merged into one, catch up on all ticks since
+  while (now - current_tick >= ticks_per_slot) {
+    current_tick += ticks_per_slot;
+    advance();
+  }
+}
+
+/***************************************************************************************************
+ * Static Function Definitions
+ **************************************************************************************************/
+static void tick_timer_cb(sl_sleeptimer_timer_handle_t *handle, void *data)
+{
+  (void)handle;
+  (void)data;
+  // Timer callbacks call the Bluetooth API, so they run from the Bluetooth event handler
+  sl_bt_external_signal(TIMER_WHEEL_SIGNAL);
+}
+
+static void advance(void)
+{
+  timer_wheel_timer_t *head;
+  timer_wheel_timer_t *timer;
+  timer_wheel_timer_t *next;
+
+  current++;
+
+  // Move the timers of the next second level slot down as the first level wraps
+  if ((current & SLOT_MASK) == 0) {
+    head = &slots[1][(current >> TIMER_WHEEL_SLOT_BITS) & SLOT_MASK];
+    timer = head->next;
+    head->next = head;
+    head->prev = head;
+    while (timer != head) {
+      next = timer->next;
+      insert(timer);
+      timer = next;
+    }
+  }
+
+  // Every timer in a first level slot is due, they are at most one revolution ahead
+  head = &slots[0][current & SLOT_MASK];
+  while (head->next != head) {
+    timer = head->next;
+    detach(timer);
+    if (timer->period > 0) {
+      timer->expiry += timer->period;
+      insert(timer);
+    }
+    timer->callback(timer, timer->data);
+  }
+}
+
+static void insert(timer_wheel_timer_t *timer)
+{
+  uint32_t delta = timer->expiry - current;
+  timer_wheel_timer_t *head;
+
+  if (delta < TIMER_WHEEL_SLOTS) {
+    head = &slots[0][timer->expiry & SLOT_MASK];
+  } else if (delta < TIMER_WHEEL_SLOTS * TIMER_WHEEL_SLOTS) {
+    head = &slots[1][(timer->expiry >> TIMER_WHEEL_SLOT_BITS) & SLOT_MASK];
+  } else {
+    // Out of range, parked in the second level slot furthest ahead and inserted again from there
+    head = &slots[1][(current >> TIMER_WHEEL_SLOT_BITS) & SLOT_MASK];
+  }
+
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+static void detach(timer_wheel_timer_t *timer)
+{
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = NULL;
+  timer->prev = NULL;
+}
+
+static uint32_t ms_to_ticks(uint32_t ms)
+{
+  // Rounded up, and at least to the next tick
+  uint32_t ticks = (ms + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+
+  return (ticks > 0) ? ticks : 1;
+}
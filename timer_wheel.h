@@ -0,0 +1,89 @@
+/***********************************************************************************************//**
+ * @file
+ * @brief  Timer wheel header file
+ ***************************************************************************************************
+ * # License
+ * <b>Copyright 2020 Silicon Laboratories Inc. www.silabs.com</b>
+ ***************************************************************************************************
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this software is governed
+ * by the terms of Silicon Labs Master Software License Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This software is distributed to
+ * you in Source Code format and is governed by the sections of the MSLA applicable to Source Code.
+ **************************************************************************************************/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************************************************//**
+ * @addtogroup Application
+ * @{
+ **************************************************************************************************/
+
+/***********************************************************************************************//**
+ * @addtogroup app
+ * @{
+ **************************************************************************************************/
+
+// Two levels of slots: the first covers TIMER_WHEEL_SLOTS ticks, the second TIMER_WHEEL_SLOTS
+// times as much. Longer timeouts are cascaded again until they are in range.
+#define TIMER_WHEEL_TICK_MS   100
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS     (1 << TIMER_WHEEL_SLOT_BITS)
+
+// External signal of the wheel tick, handled in the Bluetooth event handler
+#define TIMER_WHEEL_SIGNAL    (1 << 0)
+
+/***************************************************************************************************
+ * Type Definitions
+ **************************************************************************************************/
+
+typedef struct timer_wheel_timer timer_wheel_timer_t;
+
+// Called from timer_wheel_process(), the timer may be restarted or stopped from the callback
+typedef void (*timer_wheel_callback_t)(timer_wheel_timer_t *timer, void *data);
+
+// Embedded in the owner, no memory is allocated by the wheel
+struct timer_wheel_timer {
+  timer_wheel_timer_t *next;    // Slot list, NULL when the timer is not running
+  timer_wheel_timer_t *prev;
+  uint32_t expiry;              // Wheel tick
+  uint32_t period;              // Ticks, 0 for a one-shot timer
+  timer_wheel_callback_t callback;
+  void *data;
+};
+
+/***************************************************************************************************
+ * Function Declarations
+ **************************************************************************************************/
+
+void timer_wheel_init(void);
+
+// (Re)start a timer, period_ms 0 for a one-shot timer. O(1), also when it is already running.
+void timer_wheel_start(timer_wheel_timer_t *timer,
+                       uint32_t timeout_ms,
+                       uint32_t period_ms,
+                       timer_wheel_callback_t callback,
+                       void *data);
+
+void timer_wheel_stop(timer_wheel_timer_t *timer);
+
+bool timer_wheel_is_running(const timer_wheel_timer_t *timer);
+
+// Advance the wheel to the current time and call the expired timers, on TIMER_WHEEL_SIGNAL
+void timer_wheel_process(void);
+
+/** @} (end addtogroup app) */
+/** @} (end addtogroup Application) */
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* TIMER_WHEEL_H */